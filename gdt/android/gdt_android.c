@@ -26,14 +26,19 @@
 #include <android/log.h>
 #include <jni.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include <gdt/gdt.h>
 #include "sys/time.h"
+#include "../gdt_internal.h"
 
 
 struct resource {
 	void* ptr;
-	jobject extra;
+	jobject extra; // NULL if mapped from the resource directory
 	int32_t length;
 };
 
@@ -53,10 +58,12 @@ string_t eventSubscribeSig = "(IZ)V";
 
 string_t cacheDir;
 string_t storageDir;
+string_t apkPath;
 touchhandler_t cb_touch = NULL;
 accelerometerhandler_t cb_accelerometer = NULL;
 jclass cls;
-JNIEnv* env;
+JavaVM* vm;
+__thread JNIEnv* env; // per thread, set on every call from Java
 int _screenHeight;
 int _screenWidth;
 jmethodID openUrl;
@@ -68,6 +75,9 @@ jmethodID playerDestroy;
 jmethodID playerPlay;
 jmethodID setKbdMode;
 jmethodID eventSubscribe;
+const string_t* idPaths = NULL;
+jobject* idStrings = NULL;
+int32_t idCount = 0;
 
 static touch_type_t mapAction (int what) {
 	switch (what) {
@@ -97,12 +107,49 @@ static int mapType(log_type_t type) {
 
 
 
-void Java_gdt_Native_initialize(JNIEnv* e, jclass c, jstring cachePath, jstring storagePath) {
+static uint64_t ns(struct timespec* t) {
+	return (uint64_t) t->tv_sec * 1000000000LL + (uint64_t) t->tv_nsec;
+}
+
+// When the process was forked from the zygote, on the gdt_time_ns() clock, or 0 if unknown
+static uint64_t processStartTime(void) {
+	char buf[1024];
+	FILE* f = fopen("/proc/self/stat", "r");
+	if (f == NULL)
+		return 0;
+	size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[len] = '\0';
+
+	// The start time, in clock ticks since boot, is the 20th field after the command name
+	char* p = strrchr(buf, ')');
+	int field;
+	for (field = 0; p && field < 20; field++)
+		p = strchr(p + 1, ' ');
+	if (p == NULL)
+		return 0;
+
+	uint64_t sinceBoot = strtoull(p + 1, NULL, 10) * 1000000000LL / sysconf(_SC_CLK_TCK);
+
+	struct timespec boot, now;
+	clock_gettime(CLOCK_BOOTTIME, &boot);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t age = ns(&boot) - sinceBoot;
+	return age < ns(&now) ? ns(&now) - age : 0;
+}
+
+void Java_gdt_Native_initialize(JNIEnv* e, jclass c, jstring cachePath, jstring storagePath, jstring packagePath) {
 	env = e;
 	static bool initialized = false;
 	if (!initialized) {
 		initialized = true;
+		gdt_startup_mark("Native.initialize");
+
+		uint64_t processStart = processStartTime();
+		if (processStart)
+			gdt_startup_mark_at("process start", processStart);
 
+		(*env)->GetJavaVM(env, &vm);
 		cls = (*env)->NewGlobalRef(env, c);
 		openUrl = (*env)->GetStaticMethodID(env, cls, "openUrl", openUrlSig);
 		gcCollect = (*env)->GetStaticMethodID(env, cls, "gcCollect", gcCollectSig);
@@ -115,37 +162,53 @@ void Java_gdt_Native_initialize(JNIEnv* e, jclass c, jstring cachePath, jstring
 		cacheDir = (*env)->GetStringUTFChars(env, cachePath, NULL);
 		storageDir = (*env)->GetStringUTFChars(env, storagePath, NULL);
 		setKbdMode = (*env)->GetStaticMethodID(env, cls, "setKbdMode", setKbdModeSig);
+		apkPath = (*env)->GetStringUTFChars(env, packagePath, NULL);
+		gdt_startup_mark("JNI methods resolved");
 
+		gdt_prefetch_launch();
 		gdt_hook_initialize();
+		gdt_startup_mark("gdt_hook_initialize");
 	}
 }
 
+// Right after initialize, whether input can skip the GL thread's lock
+jboolean Java_gdt_Native_simulating(JNIEnv* e, jclass _) {
+	env = e;
+	return gdt_sim_running();
+}
+
 void Java_gdt_Native_render(JNIEnv* e, jclass _) {
 	env = e;
-	gdt_hook_render();
+	gdt_common_render();
+}
+
+// After the first frame has been swapped
+void Java_gdt_Native_presented(JNIEnv* e, jclass _) {
+	env = e;
+	gdt_startup_frame_presented();
 }
 
 void Java_gdt_Native_hidden(JNIEnv* e, jclass _) {
 	env = e;
-	gdt_hook_hidden();
+	gdt_common_hidden();
 }
 
 void Java_gdt_Native_visible(JNIEnv* e, jclass _, jboolean newSurface, jint width, jint height) {
 	env = e;
 	_screenWidth = width;
-	_screenHeight = height;
-	gdt_hook_visible(newSurface);
+	__atomic_store_n(&_screenHeight, height, __ATOMIC_RELAXED); // touches may come in on the UI thread meanwhile
+	gdt_common_visible(newSurface);
 }
 
 void Java_gdt_Native_active(JNIEnv* e, jclass _) {
 	env = e;
-	gdt_hook_active();
+	gdt_common_active();
 }
 
 void Java_gdt_Native_inactive(JNIEnv* e, jclass _) {
 	env = e;
-	gdt_hook_inactive();
-	gdt_hook_save_state();
+	gdt_common_inactive();
+	gdt_common_save_state();
 }
 
 void Java_gdt_Native_eventTouch(JNIEnv* e, jclass _, jint what, jfloat x, jfloat y) {
@@ -153,7 +216,7 @@ void Java_gdt_Native_eventTouch(JNIEnv* e, jclass _, jint what, jfloat x, jfloat
 	if (cb_touch) {
 		touch_type_t action = mapAction(what);
 		if (action != -1)
-			cb_touch(action, x, _screenHeight-y);
+			gdt_common_touch(cb_touch, action, x, __atomic_load_n(&_screenHeight, __ATOMIC_RELAXED) - y);
 	}
 }
 
@@ -166,7 +229,7 @@ void Java_gdt_Native_eventAccelerometer(JNIEnv* e, jclass _, jdouble time, jfloa
 		a.y = y;
 		a.z = z;
 		a.time = time;
-		cb_accelerometer(&a);
+		gdt_common_accelerometer(cb_accelerometer, &a);
 	}
 }
 
@@ -199,34 +262,83 @@ int32_t gdt_resource_length(resource_t res) {
 	return res->length;
 }
 
-resource_t gdt_resource_load(string_t p) {
-	if (p == NULL || p[0] != '/')
-		return NULL;
+static resource_t load_asset(string_t p, jstring path) {
+	resource_t res = (resource_t)malloc(sizeof(struct resource));
 
-	string_t path = p+1;
+	res->ptr = gdt_resource_dir_map(p, &res->length);
+	if (res->ptr) {
+		res->extra = NULL;
+		return res;
+	}
 
 	jobject arr = (*env)->NewGlobalRef(
 		env, (*env)->CallStaticObjectMethod(
-			env, cls, loadAsset, (*env)->NewStringUTF(env, path)
+			env, cls, loadAsset, path
 		)
 	);
 
 	jobject buffer = (*env)->GetObjectArrayElement(env, arr, 0);
 
-	resource_t res = (resource_t)malloc(sizeof(struct resource));
-
 	res->length = (*env)->GetDirectBufferCapacity(env, buffer);
 	res->ptr = (*env)->GetDirectBufferAddress(env, buffer);
 	res->extra = arr;
 
+	// Assets are mapped straight from the APK, {start offset, length} says where
+	if (gdt_prefetch_recording()) {
+		jlong range[2];
+		jobject where = (*env)->GetObjectArrayElement(env, arr, 2);
+		(*env)->GetLongArrayRegion(env, where, 0, 2, range);
+		gdt_prefetch_note(apkPath, range[0], range[1]);
+	}
+
 	return res;
 }
 
+resource_t gdt_resource_load(string_t p) {
+	if (p == NULL || p[0] != '/')
+		return NULL;
+
+	string_t path = p+1;
+
+	return load_asset(p, (*env)->NewStringUTF(env, path));
+}
+
+void gdt_resource_set_id_table(const string_t* resourcePaths, int32_t count) {
+	int32_t i;
+	for (i = 0; i < idCount; i++)
+		if (idStrings[i])
+			(*env)->DeleteGlobalRef(env, idStrings[i]);
+	free(idStrings);
+
+	idPaths = resourcePaths;
+	idCount = count;
+	idStrings = (jobject*)calloc(count, sizeof(jobject));
+}
+
+resource_t gdt_resource_load_id(resource_id_t id) {
+	if (id < 0 || id >= idCount)
+		return NULL;
+
+	string_t p = idPaths[id];
+	if (p == NULL || p[0] != '/')
+		return NULL;
+
+	// The Java string is created once and kept for the next load of the same ID
+	if (idStrings[id] == NULL)
+		idStrings[id] = (*env)->NewGlobalRef(env, (*env)->NewStringUTF(env, p+1));
+
+	return load_asset(p, idStrings[id]);
+}
+
 void gdt_resource_unload(resource_t res) {
 	jobject arr = res->extra;
 
-	(*env)->CallStaticBooleanMethod(env, cls, cleanAsset, arr);
-	(*env)->DeleteGlobalRef(env, arr);
+	if (arr) {
+		(*env)->CallStaticBooleanMethod(env, cls, cleanAsset, arr);
+		(*env)->DeleteGlobalRef(env, arr);
+	} else {
+		munmap(res->ptr, res->length);
+	}
 	
 	free(res);
 }
@@ -297,6 +409,15 @@ void gdt_exit(exit_type_t type) {
 	// EXIT_FAIL should_--> "app has encountered error"
 }
 
+void gdt_platform_thread_begin(void) {
+	(*vm)->AttachCurrentThread(vm, &env, NULL);
+}
+
+void gdt_platform_thread_end(void) {
+	(*vm)->DetachCurrentThread(vm);
+	env = NULL;
+}
+
 void gdt_gc_hint(void) {
 	(*env)->CallStaticObjectMethod(env, cls, gcCollect);
 }
@@ -304,7 +425,7 @@ void gdt_gc_hint(void) {
 uint64_t gdt_time_ns(void) {
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
-	return (uint64_t) now.tv_sec * 1000000000LL + (uint64_t) now.tv_nsec;
+	return ns(&now);
 }
 
 int32_t gdt_surface_width(void) {
@@ -100,17 +100,29 @@ final class GdtView extends GLSurfaceView {
 	private int _h = -1;
 	private boolean _newGL;
 	private boolean _hasDelayedActive = false;
+	private boolean _presented = false;
+	// gdt_sim_start() queues input and the active/inactive hooks for the
+	// simulation thread, so they need not wait for a frame to be rendered
+	private boolean _simulating = false;
 	
 	public void doResume() {
 		synchronized(lock) {
-			if (_w == -1)
+			if (_w == -1) {
 				_hasDelayedActive = true;
-			else
+				return;
+			}
+			if (!_simulating) {
 				activate();
-		} 
+				return;
+			}
+		}
+		Native.active();
 	}
 	public void doPause() {
-		synchronized(lock) { Native.inactive(); }		
+		if (_simulating)
+			Native.inactive();
+		else
+			synchronized(lock) { Native.inactive(); }
 	}
 	
 	public void doStart() {
@@ -125,7 +137,10 @@ final class GdtView extends GLSurfaceView {
 	
 	public GdtView(final Context ctx) {
 		super(ctx);
-		synchronized(lock) { Native.init(ctx); }
+		synchronized(lock) {
+			Native.init(ctx);
+			_simulating = Native.simulating();
+		}
 		setEGLContextClientVersion(2);
 		setRenderer(new Renderer() {
 			public void onSurfaceCreated(GL10 _, EGLConfig __) {
@@ -142,15 +157,25 @@ final class GdtView extends GLSurfaceView {
 			} 
 			public void onDrawFrame(GL10 _) { 
 				synchronized(lock) { Native.render(); }
+				// Queued events run on this thread as soon as the frame has been swapped
+				if (!_presented) {
+					_presented = true;
+					queueEvent(new Runnable() {
+						public void run() {
+							synchronized(lock) { Native.presented(); }
+						}
+					});
+				}
 			} 
 		});
 	} 
 
 
 	public boolean onTouchEvent(final MotionEvent ev) {
-		synchronized(lock) { 
+		if (_simulating)
 			Native.eventTouch(ev.getAction(), ev.getX(), ev.getY());
-		}
+		else
+			synchronized(lock) { Native.eventTouch(ev.getAction(), ev.getX(), ev.getY()); }
 		return true;
 	}
 
@@ -187,8 +212,10 @@ final class Native {
 	};
 	
 	
-	static native void initialize(String cacheDir, String storageDir);
+	static native void initialize(String cacheDir, String storageDir, String packagePath);
+	static native boolean simulating();
 	static native void render();
+	static native void presented();
 	static native void hidden();
 	static native void active(); 
 	static native void inactive(); 
@@ -205,17 +232,18 @@ final class Native {
 		_ctx = ctx;
 		_inputMethodManager = (InputMethodManager) _ctx.getSystemService(Context.INPUT_METHOD_SERVICE);
 		_sensorManager = (SensorManager)_ctx.getSystemService(Context.SENSOR_SERVICE);
-		initialize(_ctx.getCacheDir().getPath(), _ctx.getFilesDir().getPath());
+		initialize(_ctx.getCacheDir().getPath(), _ctx.getFilesDir().getPath(), _ctx.getApplicationInfo().sourceDir);
 	}
 	
 	static Object[] openAsset(final String fileName) {
-		final Object[] a = new Object[2];
+		final Object[] a = new Object[3];
 		try { 
 			final AssetFileDescriptor fd = _ctx.getAssets().openFd(fileName);
 			final FileInputStream stream = fd.createInputStream();
 			final FileChannel channel = stream.getChannel();
 			a[0] = channel.map(FileChannel.MapMode.READ_ONLY, channel.position(), fd.getLength());// the bytebuffer
 			a[1] = channel; // this will be closed when resource is unloaded
+			a[2] = new long[] { fd.getStartOffset(), fd.getLength() }; // where in the APK, for prefetching
 			return a;		 
 		} catch (final IOException e) {
 			return null;
@@ -22,7 +22,7 @@
  * THE SOFTWARE.
  */
 
-#include <gdt/gdt.h>
+#include "gdt_internal.h"
 
 void gdt_log(log_type_t type, string_t tag, string_t format, ...) {
     va_list args;
@@ -43,3 +43,70 @@ void gdt_fatal(string_t tag, string_t format, ...) {
     
     gdt_exit(EXIT_FAIL);
 }
+
+void gdt_common_render(void) {
+    gdt_resource_dir_poll();
+
+    uint64_t start = gdt_time_ns();
+    gdt_prefetch_poll(start);
+    gdt_timer_advance(start);
+    gdt_gl_restore(start);
+    gdt_texture_update(start);
+    gdt_hook_render();
+    uint64_t end = gdt_time_ns();
+    gdt_frame_stats_record(start, end);
+
+    gdt_startup_frame_rendered();
+    gdt_startup_run_deferred(end);
+}
+
+void gdt_common_visible(bool newContext) {
+    static bool first = true;
+
+    if (newContext)
+        gdt_gl_context_lost();
+    gdt_hook_visible(newContext);
+    if (first) {
+        first = false;
+        gdt_startup_mark("gdt_hook_visible");
+    }
+    gdt_sim_set_visible(true);
+}
+
+void gdt_common_hidden(void) {
+    gdt_frame_stats_pause();
+    gdt_prefetch_phase_end();
+    gdt_timer_pause();
+    gdt_sim_set_visible(false);
+    gdt_hook_hidden();
+}
+
+void gdt_common_touch(touchhandler_t cb, touch_type_t what, int x, int y) {
+    if (!gdt_sim_post_touch(cb, what, x, y))
+        cb(what, x, y);
+}
+
+void gdt_common_text(texthandler_t cb, string_t text) {
+    if (!gdt_sim_post_text(cb, text))
+        cb(text);
+}
+
+void gdt_common_accelerometer(accelerometerhandler_t cb, accelerometer_data_t* data) {
+    if (!gdt_sim_post_accelerometer(cb, data))
+        cb(data);
+}
+
+void gdt_common_active(void) {
+    if (!gdt_sim_post_hook(SIM_HOOK_ACTIVE))
+        gdt_hook_active();
+}
+
+void gdt_common_inactive(void) {
+    if (!gdt_sim_post_hook(SIM_HOOK_INACTIVE))
+        gdt_hook_inactive();
+}
+
+void gdt_common_save_state(void) {
+    if (!gdt_sim_post_hook(SIM_HOOK_SAVE_STATE))
+        gdt_hook_save_state();
+}
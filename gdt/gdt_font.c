@@ -0,0 +1,1142 @@
+/*
+ * gdt_font.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gdt_internal.h"
+#include <gdt/gdt_font.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+static string_t TAG = "gdt_font";
+
+#define CELL 32         // texels per glyph, a side
+#define SPREAD 4        // texels of distance either way of the outline
+#define ATLAS 512       // texels, a side
+#define CELLS_PER_ROW (ATLAS / CELL)
+#define CELL_COUNT (CELLS_PER_ROW * CELLS_PER_ROW)
+#define MAX_COMPONENT_DEPTH 4
+#define LAYOUT_SETS 64
+#define LAYOUT_WAYS 4
+#define MAX_QUADS 16384 // per draw call, 65536 vertices is the most 16 bit indices reach
+
+struct font {
+	resource_t resource;
+	const uint8_t* bytes;
+	uint32_t length;
+
+	uint32_t glyf;
+	uint32_t loca;
+	uint32_t hmtx;
+	uint32_t cmap;       // the subtable used
+	uint32_t kernPairs;  // 0 if none
+	int32_t kernCount;
+	bool longLoca;
+	int32_t glyphCount;
+	int32_t metricCount; // glyphs with their own advance in hmtx
+
+	int32_t unitsPerEm;
+	int32_t ascender;
+	int32_t descender;   // negative
+	int32_t lineGap;
+
+	int16_t* cells;      // per glyph, -1 if not in the atlas
+};
+
+typedef struct {
+	font_t font;         // NULL if free
+	uint16_t glyph;
+	uint64_t frame;      // last drawn in
+	int16_t prev;        // most recently drawn first
+	int16_t next;
+
+	float rect[4];       // x0, y0, x1, y1 the cell covers, in font units from the glyph origin
+	float texelsPerUnit;
+} cell_t;
+
+typedef struct {
+	uint16_t glyph;
+	float x;             // of the glyph origin, in font units from the first baseline
+	float y;
+} placed_t;
+
+typedef struct {
+	font_t font;         // NULL if unused
+	uint32_t hash;
+	char* text;
+	placed_t* glyphs;
+	int32_t count;
+	float width;         // in font units
+	int32_t lines;
+	uint64_t used;
+} layout_t;
+
+typedef struct {
+	float x, y;
+	uint16_t u, v;
+	uint8_t rgba[4];
+	float sharpness;
+} vertex_t;
+
+typedef struct {
+	float x0, y0, x1, y1;
+} segment_t;
+
+// A segment close enough to a row to matter, ready for distances
+typedef struct {
+	float x0, y0, dx, dy;
+	float inverseLength;
+	float left, right;
+} near_t;
+
+typedef struct {
+	float x;
+	int32_t direction;
+} crossing_t;
+
+static cell_t _cells[CELL_COUNT];
+static int16_t _lruHead = -1;
+static int16_t _lruTail = -1;
+
+static layout_t _layouts[LAYOUT_SETS][LAYOUT_WAYS];
+
+static segment_t* _segments = NULL;
+static int32_t _segmentCount = 0;
+static int32_t _segmentCapacity = 0;
+
+static vertex_t* _vertices = NULL;
+static int32_t _quadCount = 0;
+static int32_t _quadCapacity = 0;
+
+static int32_t _fontCount = 0;
+static globject_t _atlas = NULL;
+static globject_t _program = NULL;
+static globject_t _vertexBuffer = NULL;
+static globject_t _indexBuffer = NULL;
+static uint32_t _programGeneration = 0;
+static GLint _scaleUniform;
+static GLint _atlasUniform;
+
+// Counted up by gdt_font_flush()
+static uint64_t _frame = 1;
+
+static font_stats_t _stats;
+
+static string_t vertexShader =
+	"attribute vec2 position;\n"
+	"attribute vec2 texcoord;\n"
+	"attribute vec4 color;\n"
+	"attribute float sharpness;\n"
+	"uniform vec2 scale;\n"
+	"varying vec2 v_texcoord;\n"
+	"varying vec4 v_color;\n"
+	"varying float v_sharpness;\n"
+	"void main() {\n"
+	"	v_texcoord = texcoord;\n"
+	"	v_color = color;\n"
+	"	v_sharpness = sharpness;\n"
+	"	gl_Position = vec4(position * scale - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+// The distance field is 0.5 on the outline, sharpness turns texels of it into pixels
+static string_t fragmentShader =
+	"precision mediump float;\n"
+	"uniform sampler2D atlas;\n"
+	"varying vec2 v_texcoord;\n"
+	"varying vec4 v_color;\n"
+	"varying float v_sharpness;\n"
+	"void main() {\n"
+	"	float d = texture2D(atlas, v_texcoord).r - 0.5;\n"
+	"	gl_FragColor = vec4(v_color.rgb, v_color.a * clamp(d * v_sharpness + 0.5, 0.0, 1.0));\n"
+	"}\n";
+
+static const string_t attributes[] = { "position", "texcoord", "color", "sharpness" };
+
+
+// --- TrueType ---
+
+static uint16_t u16(const uint8_t* p) {
+	return p[0] << 8 | p[1];
+}
+
+static int16_t i16(const uint8_t* p) {
+	return (int16_t)u16(p);
+}
+
+static uint32_t u32(const uint8_t* p) {
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+// Offset of a table with at least minLength bytes, 0 if there is none
+static uint32_t find_table(font_t f, string_t tag, uint32_t minLength, uint32_t* length) {
+	int32_t i, count = u16(f->bytes + 4);
+	if (12 + 16 * count > f->length)
+		return 0;
+
+	for (i = 0; i < count; i++) {
+		const uint8_t* r = f->bytes + 12 + 16 * i;
+		uint32_t offset = u32(r + 8);
+		uint32_t size = u32(r + 12);
+		if (memcmp(r, tag, 4) == 0) {
+			if (offset > f->length || size > f->length - offset || size < minLength)
+				return 0;
+			if (length)
+				*length = size;
+			return offset;
+		}
+	}
+	return 0;
+}
+
+// A Unicode subtable of a format we read, preferring the full repertoire
+static uint32_t find_cmap(font_t f, uint32_t cmap, uint32_t length) {
+	uint32_t best = 0;
+	int32_t i, count = u16(f->bytes + cmap + 2);
+	if (4 + 8 * count > length)
+		return 0;
+
+	for (i = 0; i < count; i++) {
+		const uint8_t* r = f->bytes + cmap + 4 + 8 * i;
+		int32_t platform = u16(r);
+		int32_t encoding = u16(r + 2);
+		uint32_t offset = u32(r + 4);
+		if (offset + 8 > length)
+			continue;
+
+		int32_t format = u16(f->bytes + cmap + offset);
+		bool unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+		if (unicode && format == 12)
+			return cmap + offset;
+		if (unicode && format == 4 && best == 0)
+			best = cmap + offset;
+	}
+	return best;
+}
+
+static uint16_t glyph_index(font_t f, uint32_t c) {
+	const uint8_t* t = f->bytes + f->cmap;
+	const uint8_t* end = f->bytes + f->length;
+
+	if (u16(t) == 12) {
+		uint32_t lo = 0, hi = u32(t + 12);
+		if (t + 16 + 12 * (uint64_t)hi > end)
+			return 0;
+		while (lo < hi) {
+			uint32_t mid = (lo + hi) / 2;
+			const uint8_t* g = t + 16 + 12 * mid;
+			if (c < u32(g))
+				hi = mid;
+			else if (c > u32(g + 4))
+				lo = mid + 1;
+			else
+				return (uint16_t)(u32(g + 8) + c - u32(g));
+		}
+		return 0;
+	}
+
+	if (c > 0xffff)
+		return 0;
+	int32_t segments = u16(t + 6) / 2;
+	if (t + 16 + 8 * segments > end)
+		return 0;
+
+	int32_t i;
+	for (i = 0; i < segments; i++) {
+		if (u16(t + 14 + 2 * i) < c)
+			continue;
+
+		const uint8_t* start = t + 16 + 2 * segments + 2 * i;
+		const uint8_t* delta = start + 2 * segments;
+		const uint8_t* rangeOffset = delta + 2 * segments;
+		if (c < u16(start))
+			return 0;
+		if (u16(rangeOffset) == 0)
+			return (uint16_t)(c + u16(delta));
+
+		const uint8_t* g = rangeOffset + u16(rangeOffset) + 2 * (c - u16(start));
+		if (g + 2 > end || u16(g) == 0)
+			return 0;
+		return (uint16_t)(u16(g) + u16(delta));
+	}
+	return 0;
+}
+
+static int32_t advance(font_t f, uint16_t glyph) {
+	int32_t i = glyph < f->metricCount ? glyph : f->metricCount - 1;
+	return u16(f->bytes + f->hmtx + 4 * i);
+}
+
+static int32_t kerning(font_t f, uint16_t left, uint16_t right) {
+	uint32_t key = (uint32_t)left << 16 | right;
+	int32_t lo = 0, hi = f->kernCount;
+	while (lo < hi) {
+		int32_t mid = (lo + hi) / 2;
+		const uint8_t* p = f->bytes + f->kernPairs + 6 * mid;
+		uint32_t k = u32(p);
+		if (key < k)
+			hi = mid;
+		else if (key > k)
+			lo = mid + 1;
+		else
+			return i16(p + 4);
+	}
+	return 0;
+}
+
+// The outline of glyph in glyf, NULL if it has none (like a space)
+static const uint8_t* glyph_data(font_t f, uint16_t glyph, uint32_t* length) {
+	if (glyph >= f->glyphCount)
+		return NULL;
+
+	uint32_t start, end;
+	if (f->longLoca) {
+		start = u32(f->bytes + f->loca + 4 * glyph);
+		end = u32(f->bytes + f->loca + 4 * glyph + 4);
+	} else {
+		start = 2 * u16(f->bytes + f->loca + 2 * glyph);
+		end = 2 * u16(f->bytes + f->loca + 2 * glyph + 2);
+	}
+
+	if (end <= start + 10 || f->glyf + (uint64_t)end > f->length)
+		return NULL;
+	*length = end - start;
+	return f->bytes + f->glyf + start;
+}
+
+
+
+// --- Outlines ---
+
+static void add_segment(float x0, float y0, float x1, float y1) {
+	if (_segmentCount == _segmentCapacity) {
+		int32_t capacity = _segmentCapacity ? 2 * _segmentCapacity : 256;
+		segment_t* segments = (segment_t*)realloc(_segments, capacity * sizeof(segment_t));
+		if (segments == NULL)
+			return;
+		_segments = segments;
+		_segmentCapacity = capacity;
+	}
+
+	segment_t* s = &_segments[_segmentCount++];
+	s->x0 = x0;
+	s->y0 = y0;
+	s->x1 = x1;
+	s->y1 = y1;
+}
+
+// A quadratic curve as lines, in texels, finer the more it bends
+static void add_curve(float x0, float y0, float cx, float cy, float x1, float y1) {
+	float dx = x0 - 2 * cx + x1;
+	float dy = y0 - 2 * cy + y1;
+	int32_t n = 1 + (int32_t)sqrtf(sqrtf(dx * dx + dy * dy) * 4);
+	if (n > 16)
+		n = 16;
+
+	int32_t i;
+	float px = x0, py = y0;
+	for (i = 1; i <= n; i++) {
+		float t = (float)i / n;
+		float u = 1 - t;
+		float x = u * u * x0 + 2 * u * t * cx + t * t * x1;
+		float y = u * u * y0 + 2 * u * t * cy + t * t * y1;
+		add_segment(px, py, x, y);
+		px = x;
+		py = y;
+	}
+}
+
+/* Add the outline of glyph as segments, in texels through m (a 2x3 matrix
+ * from font units, column major). Returns false if it is corrupt.
+ */
+static bool add_outline(font_t f, uint16_t glyph, const float* m, int32_t depth) {
+	uint32_t length;
+	const uint8_t* g = glyph_data(f, glyph, &length);
+	if (g == NULL)
+		return true;
+	const uint8_t* end = g + length;
+
+	int32_t contours = i16(g);
+	if (contours < 0) {
+		if (depth >= MAX_COMPONENT_DEPTH)
+			return false;
+
+		const uint8_t* p = g + 10;
+		uint16_t flags;
+		do {
+			if (p + 4 > end)
+				return false;
+			flags = u16(p);
+			uint16_t component = u16(p + 2);
+			p += 4;
+
+			float dx, dy;
+			if (flags & 0x1) { // ARG_1_AND_2_ARE_WORDS
+				if (p + 4 > end)
+					return false;
+				dx = i16(p);
+				dy = i16(p + 2);
+				p += 4;
+			} else {
+				if (p + 2 > end)
+					return false;
+				dx = (int8_t)p[0];
+				dy = (int8_t)p[1];
+				p += 2;
+			}
+			if (!(flags & 0x2)) // matched points instead of an offset, rare
+				dx = dy = 0;
+
+			float a = 1, b = 0, c = 0, d = 1;
+			if (flags & 0x8) { // WE_HAVE_A_SCALE
+				if (p + 2 > end)
+					return false;
+				a = d = i16(p) / 16384.0f;
+				p += 2;
+			} else if (flags & 0x40) { // WE_HAVE_AN_X_AND_Y_SCALE
+				if (p + 4 > end)
+					return false;
+				a = i16(p) / 16384.0f;
+				d = i16(p + 2) / 16384.0f;
+				p += 4;
+			} else if (flags & 0x80) { // WE_HAVE_A_TWO_BY_TWO
+				if (p + 8 > end)
+					return false;
+				a = i16(p) / 16384.0f;
+				b = i16(p + 2) / 16384.0f;
+				c = i16(p + 4) / 16384.0f;
+				d = i16(p + 6) / 16384.0f;
+				p += 8;
+			}
+
+			float cm[6] = {
+				m[0] * a + m[2] * b, m[1] * a + m[3] * b,
+				m[0] * c + m[2] * d, m[1] * c + m[3] * d,
+				m[0] * dx + m[2] * dy + m[4], m[1] * dx + m[3] * dy + m[5]
+			};
+			if (!add_outline(f, component, cm, depth + 1))
+				return false;
+		} while (flags & 0x20); // MORE_COMPONENTS
+		return true;
+	}
+
+	// Simple glyph: end points, instructions, then flags, xs and ys of all points
+	const uint8_t* p = g + 10 + 2 * contours;
+	if (p + 2 > end)
+		return false;
+	int32_t pointCount = contours ? u16(p - 2) + 1 : 0;
+	p += 2 + u16(p);
+	if (p > end)
+		return false;
+
+	float* xy = (float*)malloc(pointCount * 2 * sizeof(float) + pointCount);
+	if (xy == NULL)
+		return false;
+	uint8_t* flags = (uint8_t*)(xy + 2 * pointCount);
+
+	int32_t i, j;
+	for (i = 0; i < pointCount;) {
+		if (p >= end)
+			goto corrupt;
+		uint8_t flag = *p++;
+		int32_t repeat = 0;
+		if (flag & 0x8) {
+			if (p >= end)
+				goto corrupt;
+			repeat = *p++;
+		}
+		for (j = 0; j <= repeat && i < pointCount; j++)
+			flags[i++] = flag;
+	}
+
+	// Short coordinates have their sign in a flag, long ones are left out if the same
+	int32_t axis, value;
+	for (axis = 0; axis < 2; axis++) {
+		uint8_t shortBit = axis ? 0x4 : 0x2;
+		uint8_t sameBit = axis ? 0x20 : 0x10;
+		value = 0;
+		for (i = 0; i < pointCount; i++) {
+			if (flags[i] & shortBit) {
+				if (p >= end)
+					goto corrupt;
+				value += flags[i] & sameBit ? *p : -*p;
+				p++;
+			} else if (!(flags[i] & sameBit)) {
+				if (p + 2 > end)
+					goto corrupt;
+				value += i16(p);
+				p += 2;
+			}
+			xy[2 * i + axis] = value;
+		}
+	}
+
+	for (i = 0; i < pointCount; i++) {
+		float x = xy[2 * i], y = xy[2 * i + 1];
+		xy[2 * i] = m[0] * x + m[2] * y + m[4];
+		xy[2 * i + 1] = m[1] * x + m[3] * y + m[5];
+	}
+
+	/* Off-curve points are quadratic control points, with an implied
+	 * on-curve point halfway between two of them in a row.
+	 */
+	int32_t first = 0;
+	for (i = 0; i < contours; i++) {
+		int32_t last = u16(g + 10 + 2 * i);
+		if (last < first || last >= pointCount)
+			goto corrupt;
+
+		// Start on the curve, halfway between the ends if neither is on it
+		float sx, sy;
+		int32_t from = first, to = last;
+		if (flags[first] & 1) {
+			sx = xy[2 * first];
+			sy = xy[2 * first + 1];
+			from++;
+		} else if (flags[last] & 1) {
+			sx = xy[2 * last];
+			sy = xy[2 * last + 1];
+			to--;
+		} else {
+			sx = (xy[2 * first] + xy[2 * last]) / 2;
+			sy = (xy[2 * first + 1] + xy[2 * last + 1]) / 2;
+		}
+
+		float px = sx, py = sy, cx = 0, cy = 0;
+		bool control = false;
+		for (j = from; j <= to + 1; j++) {
+			// Back to the start to close the contour
+			bool on = j > to || (flags[j] & 1);
+			float x = j > to ? sx : xy[2 * j];
+			float y = j > to ? sy : xy[2 * j + 1];
+
+			if (!on && control) {
+				float mx = (cx + x) / 2, my = (cy + y) / 2;
+				add_curve(px, py, cx, cy, mx, my);
+				px = mx;
+				py = my;
+			}
+			if (!on) {
+				cx = x;
+				cy = y;
+				control = true;
+				continue;
+			}
+
+			if (control)
+				add_curve(px, py, cx, cy, x, y);
+			else
+				add_segment(px, py, x, y);
+			px = x;
+			py = y;
+			control = false;
+		}
+		first = last + 1;
+	}
+
+	free(xy);
+	return true;
+
+corrupt:
+	free(xy);
+	return false;
+}
+
+
+
+// --- Atlas ---
+
+static void unlink_cell(int16_t c) {
+	if (_cells[c].prev >= 0)
+		_cells[_cells[c].prev].next = _cells[c].next;
+	else
+		_lruHead = _cells[c].next;
+	if (_cells[c].next >= 0)
+		_cells[_cells[c].next].prev = _cells[c].prev;
+	else
+		_lruTail = _cells[c].prev;
+}
+
+static void touch_cell(int16_t c) {
+	if (c == _lruHead)
+		return;
+	unlink_cell(c);
+	_cells[c].prev = -1;
+	_cells[c].next = _lruHead;
+	_cells[_lruHead].prev = c;
+	_lruHead = c;
+}
+
+// Free cells go last, to be taken first
+static void free_cell(int16_t c) {
+	if (_cells[c].font == NULL)
+		return;
+	_cells[c].font->cells[_cells[c].glyph] = -1;
+	_cells[c].font = NULL;
+	_stats.glyphs_resident--;
+
+	if (c == _lruTail)
+		return;
+	unlink_cell(c);
+	_cells[c].next = -1;
+	_cells[c].prev = _lruTail;
+	_cells[_lruTail].next = c;
+	_lruTail = c;
+}
+
+// Recipe for the registry. Glyphs are made again as they are drawn.
+static GLuint make_atlas(void* data) {
+	int16_t c;
+	for (c = 0; c < CELL_COUNT; c++)
+		free_cell(c);
+
+	GLuint name;
+	glGenTextures(1, &name);
+	glBindTexture(GL_TEXTURE_2D, name);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, ATLAS, ATLAS, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return name;
+}
+
+/* The distance field of the segments, 0.5 on the outline, more inside and
+ * less outside, reaching 0 and 1 at SPREAD texels. Rows bottom first.
+ * Only segments within SPREAD of a texel are looked at for its distance.
+ */
+static void rasterize(uint8_t* field) {
+	near_t* near = (near_t*)malloc((_segmentCount + 1) * sizeof(near_t));
+	crossing_t* crossings = (crossing_t*)malloc((_segmentCount + 1) * sizeof(crossing_t));
+	if (near == NULL || crossings == NULL) {
+		memset(field, 0, CELL * CELL);
+		goto done;
+	}
+
+	int32_t x, y, i;
+	for (y = 0; y < CELL; y++) {
+		float py = y + 0.5f;
+		int32_t nearCount = 0, crossingCount = 0;
+
+		for (i = 0; i < _segmentCount; i++) {
+			const segment_t* s = &_segments[i];
+			float lo = s->y0 < s->y1 ? s->y0 : s->y1;
+			float hi = s->y0 < s->y1 ? s->y1 : s->y0;
+			if (lo - SPREAD <= py && py <= hi + SPREAD) {
+				near_t* n = &near[nearCount++];
+				float length;
+				n->x0 = s->x0;
+				n->y0 = s->y0;
+				n->dx = s->x1 - s->x0;
+				n->dy = s->y1 - s->y0;
+				length = n->dx * n->dx + n->dy * n->dy;
+				n->inverseLength = length > 0 ? 1 / length : 0;
+				n->left = (s->x0 < s->x1 ? s->x0 : s->x1) - SPREAD;
+				n->right = (s->x0 < s->x1 ? s->x1 : s->x0) + SPREAD;
+			}
+
+			// Where a ray along the row crosses the outline, for the nonzero rule
+			if ((s->y0 <= py) != (s->y1 <= py)) {
+				crossings[crossingCount].x = s->x0 + (py - s->y0) * (s->x1 - s->x0) / (s->y1 - s->y0);
+				crossings[crossingCount++].direction = s->y1 > s->y0 ? 1 : -1;
+			}
+		}
+
+		for (x = 0; x < CELL; x++) {
+			float px = x + 0.5f;
+			float nearest = SPREAD * SPREAD;
+			int32_t winding = 0;
+
+			for (i = 0; i < nearCount; i++) {
+				const near_t* n = &near[i];
+				if (px < n->left || px > n->right)
+					continue;
+
+				float t = ((px - n->x0) * n->dx + (py - n->y0) * n->dy) * n->inverseLength;
+				t = t < 0 ? 0 : t > 1 ? 1 : t;
+				float ex = n->x0 + t * n->dx - px, ey = n->y0 + t * n->dy - py;
+				float d = ex * ex + ey * ey;
+				if (d < nearest)
+					nearest = d;
+			}
+			for (i = 0; i < crossingCount; i++)
+				if (crossings[i].x > px)
+					winding += crossings[i].direction;
+
+			float d = sqrtf(nearest) / (2 * SPREAD);
+			float v = winding ? 0.5f + d : 0.5f - d;
+			field[y * CELL + x] = (uint8_t)(v * 255 + 0.5f);
+		}
+	}
+
+done:
+	free(near);
+	free(crossings);
+}
+
+// Put glyph in the atlas, returns its cell or -1 if there is no room
+static int16_t make_glyph(font_t f, uint16_t glyph) {
+	int16_t c = _lruTail;
+	if (_cells[c].font && _cells[c].frame == _frame) {
+		_stats.glyph_dropped++;
+		return -1;
+	}
+	if (_cells[c].font)
+		_stats.glyph_evictions++;
+	free_cell(c);
+
+	uint64_t start = gdt_time_ns();
+	uint32_t length;
+	const uint8_t* g = glyph_data(f, glyph, &length);
+	float xMin = i16(g + 2), yMin = i16(g + 4), xMax = i16(g + 6), yMax = i16(g + 8);
+
+	// As large as the line height fits, smaller for glyphs that would not fit
+	float inner = CELL - 2 * SPREAD;
+	float scale = inner / (f->ascender - f->descender);
+	if (scale * (xMax - xMin) > inner)
+		scale = inner / (xMax - xMin);
+	if (scale * (yMax - yMin) > inner)
+		scale = inner / (yMax - yMin);
+
+	float m[6] = { scale, 0, 0, scale, SPREAD - xMin * scale, SPREAD - yMin * scale };
+	_segmentCount = 0;
+	if (!add_outline(f, glyph, m, 0)) {
+		gdt_log(LOG_WARNING, TAG, "glyph %d is corrupt", glyph);
+		_segmentCount = 0;
+	}
+
+	uint8_t field[CELL * CELL];
+	rasterize(field);
+
+	// Made while queuing, in the middle of the game's drawing
+	gdt_gl_keep_bindings_begin();
+	gdt_gl_bindings_changing();
+	glBindTexture(GL_TEXTURE_2D, gdt_gl_name(_atlas));
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, (c % CELLS_PER_ROW) * CELL, (c / CELLS_PER_ROW) * CELL,
+	                CELL, CELL, GL_LUMINANCE, GL_UNSIGNED_BYTE, field);
+	gdt_gl_keep_bindings_end();
+
+	cell_t* cell = &_cells[c];
+	cell->font = f;
+	cell->glyph = glyph;
+	cell->texelsPerUnit = scale;
+	cell->rect[0] = xMin - SPREAD / scale;
+	cell->rect[1] = yMin - SPREAD / scale;
+	cell->rect[2] = cell->rect[0] + CELL / scale;
+	cell->rect[3] = cell->rect[1] + CELL / scale;
+	f->cells[glyph] = c;
+	touch_cell(c);
+
+	_stats.glyphs_resident++;
+	_stats.glyph_misses++;
+	_stats.glyph_ns += gdt_time_ns() - start;
+	return c;
+}
+
+
+
+// --- Layout ---
+
+static uint32_t decode_utf8(const uint8_t** s) {
+	const uint8_t* p = *s;
+	uint32_t c = *p++;
+	int32_t extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+	if (c >= 0x80 && c < 0xc0)
+		extra = -1;
+
+	c &= extra == 3 ? 0x07 : extra == 2 ? 0x0f : extra == 1 ? 0x1f : 0x7f;
+	for (; extra > 0; extra--, p++) {
+		if ((*p & 0xc0) != 0x80) {
+			c = 0xfffd;
+			break;
+		}
+		c = c << 6 | (*p & 0x3f);
+	}
+	*s = p;
+	return extra < 0 ? 0xfffd : c;
+}
+
+static int32_t line_height(font_t f) {
+	return f->ascender - f->descender + f->lineGap;
+}
+
+static void build_layout(font_t f, layout_t* l) {
+	const uint8_t* p = (const uint8_t*)l->text;
+	float x = 0, y = 0;
+	uint16_t previous = 0;
+
+	l->count = 0;
+	l->width = 0;
+	l->lines = 1;
+	while (*p) {
+		uint32_t c = decode_utf8(&p);
+		if (c == '\n') {
+			x = 0;
+			y -= line_height(f);
+			l->lines++;
+			previous = 0;
+			continue;
+		}
+
+		uint16_t glyph = glyph_index(f, c);
+		uint32_t length;
+		if (previous && f->kernCount)
+			x += kerning(f, previous, glyph);
+		if (glyph_data(f, glyph, &length)) {
+			placed_t* g = &l->glyphs[l->count++];
+			g->glyph = glyph;
+			g->x = x;
+			g->y = y;
+		}
+		x += advance(f, glyph);
+		if (x > l->width)
+			l->width = x;
+		previous = glyph;
+	}
+}
+
+static void free_layout(layout_t* l) {
+	free(l->text);
+	free(l->glyphs);
+	memset(l, 0, sizeof(layout_t));
+}
+
+// The cached layout of text, NULL if out of memory
+static layout_t* get_layout(font_t f, string_t text) {
+	uint32_t hash = 2166136261u ^ (uint32_t)(uintptr_t)f;
+	const uint8_t* p;
+	for (p = (const uint8_t*)text; *p; p++)
+		hash = (hash ^ *p) * 16777619u;
+
+	layout_t* set = _layouts[hash % LAYOUT_SETS];
+	layout_t* l = &set[0];
+	int32_t i;
+	for (i = 0; i < LAYOUT_WAYS; i++) {
+		if (set[i].font == f && set[i].hash == hash && strcmp(set[i].text, text) == 0) {
+			set[i].used = _frame;
+			_stats.layout_hits++;
+			return &set[i];
+		}
+		if (set[i].used < l->used)
+			l = &set[i];
+	}
+
+	// Not there, replace the least recently drawn in the set
+	_stats.layout_misses++;
+	free_layout(l);
+	size_t length = p - (const uint8_t*)text;
+	l->text = strdup(text);
+	l->glyphs = (placed_t*)malloc((length ? length : 1) * sizeof(placed_t));
+	if (l->text == NULL || l->glyphs == NULL) {
+		free_layout(l);
+		return NULL;
+	}
+
+	l->font = f;
+	l->hash = hash;
+	l->used = _frame;
+	build_layout(f, l);
+	return l;
+}
+
+
+
+// --- Drawing ---
+
+static bool reserve_quads(int32_t count) {
+	if (_quadCount + count <= _quadCapacity)
+		return true;
+
+	int32_t capacity = _quadCapacity ? _quadCapacity : 256;
+	while (capacity < _quadCount + count)
+		capacity *= 2;
+	vertex_t* vertices = (vertex_t*)realloc(_vertices, capacity * 4 * sizeof(vertex_t));
+	if (vertices == NULL)
+		return false;
+	_vertices = vertices;
+	_quadCapacity = capacity;
+	return true;
+}
+
+static void set_vertex(vertex_t* v, float x, float y, int32_t u, int32_t t, uint32_t rgba, float sharpness) {
+	v->x = x;
+	v->y = y;
+	v->u = (uint16_t)((u * 65535 + ATLAS / 2) / ATLAS);
+	v->v = (uint16_t)((t * 65535 + ATLAS / 2) / ATLAS);
+	v->rgba[0] = rgba >> 24;
+	v->rgba[1] = rgba >> 16;
+	v->rgba[2] = rgba >> 8;
+	v->rgba[3] = rgba;
+	v->sharpness = sharpness;
+}
+
+static bool start(void) {
+	int16_t c;
+	for (c = 0; c < CELL_COUNT; c++) {
+		_cells[c].font = NULL;
+		_cells[c].prev = c - 1;
+		_cells[c].next = c + 1 < CELL_COUNT ? c + 1 : -1;
+	}
+	_lruHead = 0;
+	_lruTail = CELL_COUNT - 1;
+	_stats.glyph_capacity = CELL_COUNT;
+
+	uint16_t* indices = (uint16_t*)malloc(MAX_QUADS * 6 * sizeof(uint16_t));
+	if (indices == NULL)
+		return false;
+	int32_t i;
+	for (i = 0; i < MAX_QUADS; i++) {
+		uint16_t* q = indices + 6 * i;
+		q[0] = 4 * i;
+		q[1] = 4 * i + 1;
+		q[2] = 4 * i + 2;
+		q[3] = 4 * i;
+		q[4] = 4 * i + 2;
+		q[5] = 4 * i + 3;
+	}
+
+	_atlas = gdt_gl_custom(GLOBJECT_TEXTURE, make_atlas, NULL, 0);
+	_program = gdt_gl_program(vertexShader, fragmentShader, attributes, 4, 0);
+	_indexBuffer = gdt_gl_buffer(GL_ELEMENT_ARRAY_BUFFER, indices, MAX_QUADS * 6 * sizeof(uint16_t), GL_STATIC_DRAW, 0);
+	_vertexBuffer = gdt_gl_buffer(GL_ARRAY_BUFFER, NULL, 256 * 4 * sizeof(vertex_t), GL_STREAM_DRAW, 0);
+	free(indices);
+	return _atlas && _program && _indexBuffer && _vertexBuffer;
+}
+
+static void stop(void) {
+	int32_t i, j;
+	for (i = 0; i < LAYOUT_SETS; i++)
+		for (j = 0; j < LAYOUT_WAYS; j++)
+			free_layout(&_layouts[i][j]);
+
+	if (_atlas)
+		gdt_gl_delete(_atlas);
+	if (_program)
+		gdt_gl_delete(_program);
+	if (_indexBuffer)
+		gdt_gl_delete(_indexBuffer);
+	if (_vertexBuffer)
+		gdt_gl_delete(_vertexBuffer);
+	_atlas = _program = _indexBuffer = _vertexBuffer = NULL;
+	_programGeneration = 0; // a new program starts over at generation 1
+
+	free(_vertices);
+	free(_segments);
+	_vertices = NULL;
+	_segments = NULL;
+	_quadCount = _quadCapacity = _segmentCount = _segmentCapacity = 0;
+	_stats.glyphs_resident = 0;
+}
+
+
+
+font_t gdt_font_open(string_t resourcePath) {
+	resource_t resource = gdt_resource_load(resourcePath);
+	if (resource == NULL) {
+		gdt_log(LOG_WARNING, TAG, "could not load %s", resourcePath);
+		return NULL;
+	}
+
+	font_t f = (font_t)calloc(1, sizeof(struct font));
+	if (f == NULL) {
+		gdt_resource_unload(resource);
+		return NULL;
+	}
+	f->resource = resource;
+	f->bytes = (const uint8_t*)gdt_resource_bytes(resource);
+	f->length = gdt_resource_length(resource);
+
+	uint32_t head, maxp, hhea, cmap, kern;
+	uint32_t hmtxLength, locaLength, cmapLength, kernLength;
+	if (f->length < 12 || (u32(f->bytes) != 0x00010000 && memcmp(f->bytes, "true", 4) != 0) ||
+	    !(head = find_table(f, "head", 54, NULL)) || !(maxp = find_table(f, "maxp", 6, NULL)) ||
+	    !(hhea = find_table(f, "hhea", 36, NULL)) || !(f->hmtx = find_table(f, "hmtx", 4, &hmtxLength)) ||
+	    !(f->loca = find_table(f, "loca", 4, &locaLength)) || !(f->glyf = find_table(f, "glyf", 0, NULL)) ||
+	    !(cmap = find_table(f, "cmap", 4, &cmapLength))) {
+		gdt_log(LOG_WARNING, TAG, "%s is not a TrueType font with outlines", resourcePath);
+		goto fail;
+	}
+
+	f->unitsPerEm = u16(f->bytes + head + 18);
+	f->longLoca = i16(f->bytes + head + 50) != 0;
+	f->glyphCount = u16(f->bytes + maxp + 4);
+	f->ascender = i16(f->bytes + hhea + 4);
+	f->descender = i16(f->bytes + hhea + 6);
+	f->lineGap = i16(f->bytes + hhea + 8);
+	f->metricCount = u16(f->bytes + hhea + 34);
+	f->cmap = find_cmap(f, cmap, cmapLength);
+
+	if (f->unitsPerEm == 0 || f->ascender <= f->descender || f->metricCount == 0 ||
+	    4 * (uint32_t)f->metricCount > hmtxLength ||
+	    (uint32_t)(f->glyphCount + 1) * (f->longLoca ? 4 : 2) > locaLength || f->cmap == 0) {
+		gdt_log(LOG_WARNING, TAG, "%s is not a supported font", resourcePath);
+		goto fail;
+	}
+
+	// Horizontal pairs from the first subtable, if it is one
+	if ((kern = find_table(f, "kern", 18, &kernLength)) && u16(f->bytes + kern) == 0 &&
+	    u16(f->bytes + kern + 8) == 0x0001) {
+		int32_t count = u16(f->bytes + kern + 10);
+		if (18 + 6 * (uint32_t)count <= kernLength) {
+			f->kernPairs = kern + 18;
+			f->kernCount = count;
+		}
+	}
+
+	f->cells = (int16_t*)malloc(f->glyphCount * sizeof(int16_t) + 1);
+	if (f->cells == NULL)
+		goto fail;
+	memset(f->cells, 0xff, f->glyphCount * sizeof(int16_t));
+
+	if (_fontCount == 0 && !start()) {
+		stop();
+		goto fail;
+	}
+	_fontCount++;
+	return f;
+
+fail:
+	free(f->cells);
+	free(f);
+	gdt_resource_unload(resource);
+	return NULL;
+}
+
+void gdt_font_close(font_t f) {
+	int16_t c;
+	for (c = 0; c < CELL_COUNT; c++)
+		if (_cells[c].font == f)
+			free_cell(c);
+
+	int32_t i, j;
+	for (i = 0; i < LAYOUT_SETS; i++)
+		for (j = 0; j < LAYOUT_WAYS; j++)
+			if (_layouts[i][j].font == f)
+				free_layout(&_layouts[i][j]);
+
+	gdt_resource_unload(f->resource);
+	free(f->cells);
+	free(f);
+
+	if (--_fontCount == 0)
+		stop();
+}
+
+void gdt_font_draw(font_t f, string_t text, float x, float y, float size, uint32_t rgba) {
+	// Restores the atlas now if it is lost, not after glyphs for this frame are in it
+	gdt_gl_name(_atlas);
+
+	layout_t* l = get_layout(f, text);
+	if (l == NULL || !reserve_quads(l->count))
+		return;
+
+	float scale = size / f->unitsPerEm;
+	int32_t i;
+	for (i = 0; i < l->count; i++) {
+		const placed_t* g = &l->glyphs[i];
+		int16_t c = f->cells[g->glyph];
+		if (c >= 0) {
+			_stats.glyph_hits++;
+			touch_cell(c);
+		} else if ((c = make_glyph(f, g->glyph)) < 0) {
+			continue;
+		}
+
+		cell_t* cell = &_cells[c];
+		cell->frame = _frame;
+
+		float x0 = x + (g->x + cell->rect[0]) * scale;
+		float y0 = y + (g->y + cell->rect[1]) * scale;
+		float x1 = x + (g->x + cell->rect[2]) * scale;
+		float y1 = y + (g->y + cell->rect[3]) * scale;
+		int32_t u0 = (c % CELLS_PER_ROW) * CELL, v0 = (c / CELLS_PER_ROW) * CELL;
+		float sharpness = 2 * SPREAD * scale / cell->texelsPerUnit;
+
+		vertex_t* v = _vertices + 4 * _quadCount++;
+		set_vertex(&v[0], x0, y0, u0, v0, rgba, sharpness);
+		set_vertex(&v[1], x1, y0, u0 + CELL, v0, rgba, sharpness);
+		set_vertex(&v[2], x1, y1, u0 + CELL, v0 + CELL, rgba, sharpness);
+		set_vertex(&v[3], x0, y1, u0, v0 + CELL, rgba, sharpness);
+	}
+}
+
+void gdt_font_measure(font_t f, string_t text, float size, float* width, float* height) {
+	float scale = size / f->unitsPerEm;
+	layout_t* l = get_layout(f, text);
+
+	*width = l ? l->width * scale : 0;
+	*height = l ? (f->ascender - f->descender + (l->lines - 1) * line_height(f)) * scale : 0;
+}
+
+void gdt_font_flush(void) {
+	int32_t count = _quadCount;
+	_quadCount = 0;
+	_frame++;
+
+	GLuint program = _program ? gdt_gl_name(_program) : 0;
+	if (count == 0 || program == 0 || gdt_surface_width() <= 0 || gdt_surface_height() <= 0)
+		return;
+
+	glUseProgram(program);
+	if (_programGeneration != gdt_gl_generation(_program)) {
+		_programGeneration = gdt_gl_generation(_program);
+		_scaleUniform = glGetUniformLocation(program, "scale");
+		_atlasUniform = glGetUniformLocation(program, "atlas");
+	}
+	glUniform2f(_scaleUniform, 2.0f / gdt_surface_width(), 2.0f / gdt_surface_height());
+	glUniform1i(_atlasUniform, 0);
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gdt_gl_name(_atlas));
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+	gdt_gl_buffer_stream(_vertexBuffer, _vertices, count * 4 * sizeof(vertex_t));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gdt_gl_name(_indexBuffer));
+
+	int32_t i;
+	for (i = 0; i < 4; i++)
+		glEnableVertexAttribArray(i);
+
+	// One draw unless there are more quads than 16 bit indices reach
+	int32_t first;
+	for (first = 0; first < count; first += MAX_QUADS) {
+		int32_t n = count - first < MAX_QUADS ? count - first : MAX_QUADS;
+		uintptr_t base = first * 4 * sizeof(vertex_t);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const void*)(base + offsetof(vertex_t, x)));
+		glVertexAttribPointer(1, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(vertex_t), (const void*)(base + offsetof(vertex_t, u)));
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(vertex_t), (const void*)(base + offsetof(vertex_t, rgba)));
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(vertex_t), (const void*)(base + offsetof(vertex_t, sharpness)));
+		glDrawElements(GL_TRIANGLES, n * 6, GL_UNSIGNED_SHORT, NULL);
+		_stats.draws++;
+	}
+
+	for (i = 0; i < 4; i++)
+		glDisableVertexAttribArray(i);
+	_stats.quads += count;
+}
+
+void gdt_font_stats(font_stats_t* stats) {
+	*stats = _stats;
+}
@@ -0,0 +1,306 @@
+/*
+ * gdt_frame_stats.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gdt_internal.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifdef GDT_PLATFORM_ANDROID
+#include <sys/system_properties.h>
+#endif
+
+#ifdef GDT_PLATFORM_IOS
+#include <sys/sysctl.h>
+#endif
+
+/* Durations are kept in log-linear (HDR style) histograms of microseconds:
+ * values below 2^(SUB_BITS+1) get a bucket each, above that every power of
+ * two is split into 2^SUB_BITS buckets, i.e. about 3% precision up to the
+ * full 32 bit range, in a fixed 3.6 kB per histogram.
+ */
+#define SUB_BITS 5
+#define SUB_COUNT (1 << SUB_BITS)
+#define LINEAR_COUNT (2 * SUB_COUNT)
+#define BUCKET_COUNT (LINEAR_COUNT + (32 - SUB_BITS - 1) * SUB_COUNT)
+
+#define DUMP_INTERVAL_NS 60000000000ULL
+#define DUMP_FILE "gdt_frame_stats.txt"
+
+typedef struct {
+	uint32_t counts[BUCKET_COUNT];
+	uint64_t total;
+	uint64_t sum;
+	uint32_t max;
+} histogram_t;
+
+static histogram_t _interval;
+static histogram_t _render;
+static uint64_t _missedVsyncs = 0;
+static uint64_t _longFrames = 0;
+static long_frame_t _recent[GDT_FRAME_STATS_LONG_FRAMES];
+static int32_t _recentNext = 0;
+
+static uint64_t _vsyncNs = 16666667;
+static uint64_t _longFrameNs = 41666667;
+static uint64_t _lastStart = 0; // 0 when the next frame has nothing to be compared to
+static uint64_t _lastDump = 0;
+
+// What a dump writes, copied on the render thread so the file can be written on another
+typedef struct {
+	frame_stats_t stats;
+	histogram_t interval;
+	histogram_t render;
+	uint64_t vsyncNs;
+	string_t model;
+} snapshot_t;
+
+// The periodic dump, written by the background worker while _dumping is set
+static snapshot_t _snapshot;
+static int _dumping = 0;
+
+
+static int bucket_of(uint32_t v) {
+	if (v < LINEAR_COUNT)
+		return v;
+
+	int e = 31 - __builtin_clz(v) - SUB_BITS; // >= 1
+	return LINEAR_COUNT + (e - 1) * SUB_COUNT + (int)(v >> e) - SUB_COUNT;
+}
+
+// Middle of the range of values that fall into bucket b
+static uint32_t value_of(int b) {
+	if (b < LINEAR_COUNT)
+		return b;
+
+	int e = (b - LINEAR_COUNT) / SUB_COUNT + 1;
+	uint64_t low = (uint64_t)(SUB_COUNT + (b - LINEAR_COUNT) % SUB_COUNT) << e;
+	return (uint32_t)(low + ((1ULL << e) >> 1));
+}
+
+static void record(histogram_t* h, uint32_t us) {
+	h->counts[bucket_of(us)]++;
+	h->total++;
+	h->sum += us;
+	if (us > h->max)
+		h->max = us;
+}
+
+static uint32_t percentile(const histogram_t* h, double p) {
+	if (h->total == 0)
+		return 0;
+
+	uint64_t rank = (uint64_t)(p * h->total + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	uint64_t seen = 0;
+	int b;
+	for (b = 0; b < BUCKET_COUNT; b++) {
+		seen += h->counts[b];
+		if (seen >= rank) {
+			uint32_t v = value_of(b);
+			return v < h->max ? v : h->max;
+		}
+	}
+	return h->max;
+}
+
+static uint32_t to_us(uint64_t ns) {
+	uint64_t us = ns / 1000;
+	return us > 0xffffffffULL ? 0xffffffffU : (uint32_t)us;
+}
+
+static string_t device_model(void) {
+	static char model[128];
+
+	if (model[0] == '\0') {
+#ifdef GDT_PLATFORM_ANDROID
+		__system_property_get("ro.product.model", model);
+#endif
+#ifdef GDT_PLATFORM_IOS
+		size_t len = sizeof(model) - 1;
+		sysctlbyname("hw.machine", model, &len, NULL, 0);
+#endif
+		if (model[0] == '\0')
+			strcpy(model, "unknown");
+	}
+
+	return model;
+}
+
+static void write_histogram(FILE* f, string_t name, const histogram_t* h) {
+	int b;
+	fprintf(f, "%s_histogram_us=", name);
+	for (b = 0; b < BUCKET_COUNT; b++)
+		if (h->counts[b])
+			fprintf(f, " %u:%u", value_of(b), h->counts[b]);
+	fprintf(f, "\n");
+}
+
+
+
+void gdt_frame_stats(frame_stats_t* stats) {
+	memset(stats, 0, sizeof(frame_stats_t));
+
+	stats->frames = _render.total;
+	stats->interval_mean_us = _interval.total ? _interval.sum / (double)_interval.total : 0;
+	stats->interval_p50_us = percentile(&_interval, 0.50);
+	stats->interval_p90_us = percentile(&_interval, 0.90);
+	stats->interval_p99_us = percentile(&_interval, 0.99);
+	stats->interval_max_us = _interval.max;
+	stats->render_p50_us = percentile(&_render, 0.50);
+	stats->render_p90_us = percentile(&_render, 0.90);
+	stats->render_p99_us = percentile(&_render, 0.99);
+	stats->render_max_us = _render.max;
+	stats->missed_vsyncs = _missedVsyncs;
+	stats->long_frames = _longFrames;
+
+	// The ring is copied oldest first
+	int32_t n = _longFrames < GDT_FRAME_STATS_LONG_FRAMES ? (int32_t)_longFrames : GDT_FRAME_STATS_LONG_FRAMES;
+	int32_t i;
+	for (i = 0; i < n; i++)
+		stats->recent_long_frames[i] = _recent[(_recentNext - n + i + GDT_FRAME_STATS_LONG_FRAMES) % GDT_FRAME_STATS_LONG_FRAMES];
+	stats->recent_long_frame_count = n;
+}
+
+void gdt_frame_stats_reset(void) {
+	memset(&_interval, 0, sizeof(_interval));
+	memset(&_render, 0, sizeof(_render));
+	_missedVsyncs = 0;
+	_longFrames = 0;
+	_recentNext = 0;
+	_lastStart = 0;
+}
+
+void gdt_frame_stats_configure(uint64_t vsyncNs, uint64_t longFrameNs) {
+	if (vsyncNs)
+		_vsyncNs = vsyncNs;
+	if (longFrameNs)
+		_longFrameNs = longFrameNs;
+}
+
+static void take_snapshot(snapshot_t* s) {
+	gdt_frame_stats(&s->stats);
+	s->interval = _interval;
+	s->render = _render;
+	s->vsyncNs = _vsyncNs;
+	s->model = device_model();
+}
+
+// The periodic dump has a file of its own to write to, a dump on demand could be written meanwhile
+static bool write_snapshot(const snapshot_t* snapshot, string_t tmpSuffix) {
+	string_t dir = gdt_get_cache_directory_path();
+	if (dir == NULL)
+		return false;
+
+	char path[1024];
+	char tmp[1024];
+	snprintf(path, sizeof(path), "%s/%s", dir, DUMP_FILE);
+	snprintf(tmp, sizeof(tmp), "%s%s", path, tmpSuffix);
+
+	FILE* f = fopen(tmp, "w");
+	if (f == NULL)
+		return false;
+
+	const frame_stats_t* s = &snapshot->stats;
+	fprintf(f, "model=%s\n", snapshot->model);
+	fprintf(f, "vsync_us=%u\n", to_us(snapshot->vsyncNs));
+	fprintf(f, "frames=%llu\n", (unsigned long long)s->frames);
+	fprintf(f, "interval_mean_us=%.1f\n", s->interval_mean_us);
+	fprintf(f, "interval_p50_us=%u\ninterval_p90_us=%u\ninterval_p99_us=%u\ninterval_max_us=%u\n",
+	        s->interval_p50_us, s->interval_p90_us, s->interval_p99_us, s->interval_max_us);
+	fprintf(f, "render_p50_us=%u\nrender_p90_us=%u\nrender_p99_us=%u\nrender_max_us=%u\n",
+	        s->render_p50_us, s->render_p90_us, s->render_p99_us, s->render_max_us);
+	fprintf(f, "missed_vsyncs=%llu\n", (unsigned long long)s->missed_vsyncs);
+	fprintf(f, "long_frames=%llu\n", (unsigned long long)s->long_frames);
+
+	int32_t i;
+	for (i = 0; i < s->recent_long_frame_count; i++) {
+		const long_frame_t* l = &s->recent_long_frames[i];
+		fprintf(f, "long_frame=%llu %u %u\n", (unsigned long long)l->time_ns, l->interval_us, l->render_us);
+	}
+
+	write_histogram(f, "interval", &snapshot->interval);
+	write_histogram(f, "render", &snapshot->render);
+
+	bool ok = fclose(f) == 0;
+	return ok && rename(tmp, path) == 0;
+}
+
+// Run by the background worker
+static void write_periodic(void) {
+	write_snapshot(&_snapshot, ".periodic.tmp");
+	__atomic_store_n(&_dumping, 0, __ATOMIC_RELEASE);
+}
+
+bool gdt_frame_stats_dump(void) {
+	snapshot_t s;
+	take_snapshot(&s);
+	return write_snapshot(&s, ".tmp");
+}
+
+
+
+void gdt_frame_stats_record(uint64_t start, uint64_t end) {
+	record(&_render, to_us(end - start));
+
+	if (_lastStart) {
+		uint64_t interval = start - _lastStart;
+		uint32_t us = to_us(interval);
+		record(&_interval, us);
+
+		// A frame that took n vsync periods missed n - 1 of them
+		uint64_t periods = (interval + _vsyncNs / 2) / _vsyncNs;
+		if (periods > 1)
+			_missedVsyncs += periods - 1;
+
+		if (interval >= _longFrameNs) {
+			long_frame_t* l = &_recent[_recentNext];
+			l->time_ns = start;
+			l->interval_us = us;
+			l->render_us = to_us(end - start);
+			_recentNext = (_recentNext + 1) % GDT_FRAME_STATS_LONG_FRAMES;
+			_longFrames++;
+		}
+	}
+	_lastStart = start;
+
+	if (_lastDump == 0) {
+		_lastDump = end;
+	} else if (end - _lastDump >= DUMP_INTERVAL_NS) {
+		// Only copied here, file I/O in a frame would make the long frames it is measuring
+		_lastDump = end;
+		if (__atomic_load_n(&_dumping, __ATOMIC_ACQUIRE) == 0) {
+			take_snapshot(&_snapshot);
+			__atomic_store_n(&_dumping, 1, __ATOMIC_RELAXED);
+			gdt_defer_init_background(write_periodic);
+		}
+	}
+}
+
+void gdt_frame_stats_pause(void) {
+	// Time spent hidden is not frame time
+	_lastStart = 0;
+	gdt_frame_stats_dump();
+}
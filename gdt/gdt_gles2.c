@@ -0,0 +1,640 @@
+/*
+ * gdt_gles2.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gdt_internal.h"
+#include <gdt/gdt_gles2.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef GDT_PLATFORM_ANDROID
+#include <EGL/egl.h>
+#endif
+
+static string_t TAG = "gdt_gles2";
+
+#define DEFAULT_RESTORE_BUDGET_NS 4000000
+
+struct globject {
+	globject_type_t type;
+	GLuint name;
+	bool lost; // name is 0 if not lost, the recipe failed and is not tried again until the next context
+	int32_t priority;
+	uint32_t generation;
+	uint32_t seq;   // creation order, ties in priority are restored in it
+	int32_t index;  // in _objects
+
+	GLuint (*make)(globject_t);
+	union {
+		struct {
+			char* path;
+			GLenum minFilter;
+			GLenum magFilter;
+			GLenum wrap;
+		} texture;
+		struct {
+			GLenum target;
+			GLenum usage;
+			void* data;
+			int32_t size;
+		} buffer;
+		struct {
+			char* vertexSource;
+			char* fragmentSource;
+			char** attributes;
+			int32_t attributeCount;
+		} program;
+		struct {
+			glrecipe_t recipe;
+			void* data;
+		} custom;
+	} u;
+};
+
+static globject_t* _objects = NULL;
+static int32_t _objectCount = 0;
+static int32_t _objectCapacity = 0;
+static uint32_t _seq = 0;
+
+// Lost objects in the order to restore them, from _restoreNext on
+static globject_t* _restore = NULL;
+static int32_t _restoreCount = 0;
+static int32_t _restoreNext = 0;
+
+static uint64_t _budget = DEFAULT_RESTORE_BUDGET_NS;
+
+// OES_mapbuffer, looked up once per context: -1 not yet, 0 missing, 1 there
+static int _mapbuffer = -1;
+static PFNGLMAPBUFFEROESPROC _mapBuffer = NULL;
+static PFNGLUNMAPBUFFEROESPROC _unmapBuffer = NULL;
+
+// Bindings read by gdt_gl_bindings_changing(), put back when _keepDepth drops to 0
+static int32_t _keepDepth = 0;
+static bool _kept = false;
+static GLint _keptActiveTexture;
+static GLint _keptTexture;
+static GLint _keptArrayBuffer;
+static GLint _keptElementBuffer;
+static GLint _keptUnpackAlignment;
+
+
+// --- TGA ---
+
+static uint16_t le16(const uint8_t* p) {
+	return p[0] | p[1] << 8;
+}
+
+/* Decode a TGA into GL byte order (RGB, RGBA or LUMINANCE), bottom row
+ * first as GL wants it. Returns NULL if it is not a supported TGA.
+ */
+static uint8_t* decode_tga(const uint8_t* p, int32_t length, int* width, int* height, GLenum* format) {
+	if (length < 18)
+		return NULL;
+
+	int type = p[2];
+	int w = le16(p + 12);
+	int h = le16(p + 14);
+	int bpp = p[16] / 8;
+	bool topDown = (p[17] & 0x20) != 0;
+
+	bool rle = type == 10 || type == 11;
+	bool grey = type == 3 || type == 11;
+	if (p[1] != 0 || !(type == 2 || type == 3 || type == 10 || type == 11) ||
+	    w == 0 || h == 0 || (grey ? bpp != 1 : (bpp != 3 && bpp != 4)))
+		return NULL;
+
+	const uint8_t* src = p + 18 + p[0];
+	const uint8_t* end = p + length;
+	uint8_t* pixels = (uint8_t*)malloc((size_t)w * h * bpp);
+	if (pixels == NULL)
+		return NULL;
+
+	int32_t total = w * h;
+	int32_t n = 0;
+	while (n < total) {
+		int32_t run = 1;
+		bool repeat = false;
+		if (rle) {
+			if (src >= end)
+				break;
+			run = (*src & 0x7f) + 1;
+			repeat = (*src & 0x80) != 0;
+			src++;
+		}
+		if (n + run > total)
+			run = total - n;
+
+		int32_t i;
+		for (i = 0; i < run; i++) {
+			if (src + bpp > end)
+				goto truncated;
+
+			int32_t x = n % w;
+			int32_t y = topDown ? h - 1 - n / w : n / w;
+			uint8_t* d = pixels + ((size_t)y * w + x) * bpp;
+
+			if (grey) {
+				d[0] = src[0];
+			} else {
+				d[0] = src[2];
+				d[1] = src[1];
+				d[2] = src[0];
+				if (bpp == 4)
+					d[3] = src[3];
+			}
+			n++;
+			if (!repeat)
+				src += bpp;
+		}
+		if (repeat)
+			src += bpp;
+	}
+
+	if (n < total) {
+truncated:
+		free(pixels);
+		return NULL;
+	}
+
+	*width = w;
+	*height = h;
+	*format = grey ? GL_LUMINANCE : bpp == 4 ? GL_RGBA : GL_RGB;
+	return pixels;
+}
+
+
+
+// --- Recipes ---
+
+static bool uses_mipmaps(GLenum filter) {
+	return filter != GL_NEAREST && filter != GL_LINEAR;
+}
+
+static GLuint make_texture(globject_t o) {
+	resource_t res = gdt_resource_load(o->u.texture.path);
+	if (res == NULL) {
+		gdt_log(LOG_WARNING, TAG, "could not load %s", o->u.texture.path);
+		return 0;
+	}
+
+	int width, height;
+	GLenum format;
+	uint8_t* pixels = decode_tga((const uint8_t*)gdt_resource_bytes(res), gdt_resource_length(res),
+	                             &width, &height, &format);
+	gdt_resource_unload(res);
+
+	if (pixels == NULL) {
+		gdt_log(LOG_WARNING, TAG, "%s is not a supported TGA", o->u.texture.path);
+		return 0;
+	}
+
+	GLuint name;
+	glGenTextures(1, &name);
+	glBindTexture(GL_TEXTURE_2D, name);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+	free(pixels);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, o->u.texture.minFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, o->u.texture.magFilter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, o->u.texture.wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, o->u.texture.wrap);
+	if (uses_mipmaps(o->u.texture.minFilter))
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+	return name;
+}
+
+static GLuint make_buffer(globject_t o) {
+	GLuint name;
+	glGenBuffers(1, &name);
+	glBindBuffer(o->u.buffer.target, name);
+	glBufferData(o->u.buffer.target, o->u.buffer.size, o->u.buffer.data, o->u.buffer.usage);
+	return name;
+}
+
+static GLuint compile(GLenum type, string_t source) {
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint ok;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+	if (!ok) {
+		char log[512];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		gdt_log(LOG_ERROR, TAG, "could not compile %s shader: %s",
+		        type == GL_VERTEX_SHADER ? "vertex" : "fragment", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	return shader;
+}
+
+static GLuint make_program(globject_t o) {
+	GLuint vertex = compile(GL_VERTEX_SHADER, o->u.program.vertexSource);
+	GLuint fragment = compile(GL_FRAGMENT_SHADER, o->u.program.fragmentSource);
+	GLuint program = 0;
+
+	if (vertex && fragment) {
+		program = glCreateProgram();
+		glAttachShader(program, vertex);
+		glAttachShader(program, fragment);
+
+		int32_t i;
+		for (i = 0; i < o->u.program.attributeCount; i++)
+			glBindAttribLocation(program, i, o->u.program.attributes[i]);
+
+		glLinkProgram(program);
+
+		GLint ok;
+		glGetProgramiv(program, GL_LINK_STATUS, &ok);
+		if (!ok) {
+			char log[512];
+			glGetProgramInfoLog(program, sizeof(log), NULL, log);
+			gdt_log(LOG_ERROR, TAG, "could not link program: %s", log);
+			glDeleteProgram(program);
+			program = 0;
+		}
+	}
+
+	// Flagged for deletion, they go with the program
+	if (vertex)
+		glDeleteShader(vertex);
+	if (fragment)
+		glDeleteShader(fragment);
+	return program;
+}
+
+static GLuint make_custom(globject_t o) {
+	return o->u.custom.recipe(o->u.custom.data);
+}
+
+
+
+// --- Registry ---
+
+// --- Kept bindings ---
+
+void gdt_gl_keep_bindings_begin(void) {
+	_keepDepth++;
+}
+
+void gdt_gl_bindings_changing(void) {
+	if (_keepDepth == 0 || _kept)
+		return;
+
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &_keptActiveTexture);
+	glGetIntegerv(GL_TEXTURE_BINDING_2D, &_keptTexture);
+	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &_keptArrayBuffer);
+	glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &_keptElementBuffer);
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &_keptUnpackAlignment);
+	_kept = true;
+}
+
+void gdt_gl_keep_bindings_end(void) {
+	if (--_keepDepth > 0 || !_kept)
+		return;
+
+	glActiveTexture(_keptActiveTexture);
+	glBindTexture(GL_TEXTURE_2D, _keptTexture);
+	glBindBuffer(GL_ARRAY_BUFFER, _keptArrayBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _keptElementBuffer);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, _keptUnpackAlignment);
+	_kept = false;
+}
+
+
+
+static void make(globject_t o) {
+	gdt_gl_keep_bindings_begin();
+	gdt_gl_bindings_changing();
+	o->name = o->make(o);
+	o->lost = false;
+	o->generation++;
+	gdt_gl_keep_bindings_end();
+}
+
+static globject_t add(globject_type_t type, GLuint (*fn)(globject_t), int32_t priority) {
+	if (_objectCount == _objectCapacity) {
+		int32_t capacity = _objectCapacity ? 2 * _objectCapacity : 64;
+		globject_t* objects = (globject_t*)realloc(_objects, capacity * sizeof(globject_t));
+		if (objects == NULL)
+			return NULL;
+		_objects = objects;
+		_objectCapacity = capacity;
+	}
+
+	globject_t o = (globject_t)calloc(1, sizeof(struct globject));
+	if (o == NULL)
+		return NULL;
+
+	o->type = type;
+	o->make = fn;
+	o->priority = priority;
+	o->seq = _seq++;
+	o->index = _objectCount;
+	_objects[_objectCount++] = o;
+	return o;
+}
+
+static void delete_name(globject_t o) {
+	if (o->name == 0 || o->lost)
+		return;
+
+	switch (o->type) {
+		case GLOBJECT_TEXTURE:
+			glDeleteTextures(1, &o->name);
+			break;
+		case GLOBJECT_BUFFER:
+			glDeleteBuffers(1, &o->name);
+			break;
+		case GLOBJECT_PROGRAM:
+			glDeleteProgram(o->name);
+			break;
+	}
+	o->name = 0;
+}
+
+static int by_priority(const void* a, const void* b) {
+	globject_t x = *(const globject_t*)a;
+	globject_t y = *(const globject_t*)b;
+	if (x->priority != y->priority)
+		return x->priority > y->priority ? -1 : 1;
+	return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+
+
+globject_t gdt_gl_texture(string_t resourcePath, GLenum minFilter, GLenum magFilter, GLenum wrap, int32_t priority) {
+	globject_t o = add(GLOBJECT_TEXTURE, make_texture, priority);
+	if (o == NULL)
+		return NULL;
+
+	o->u.texture.path = strdup(resourcePath);
+	o->u.texture.minFilter = minFilter;
+	o->u.texture.magFilter = magFilter;
+	o->u.texture.wrap = wrap;
+
+	make(o);
+	if (o->name == 0) {
+		gdt_gl_delete(o);
+		return NULL;
+	}
+	return o;
+}
+
+globject_t gdt_gl_buffer(GLenum target, const void* data, int32_t size, GLenum usage, int32_t priority) {
+	globject_t o = add(GLOBJECT_BUFFER, make_buffer, priority);
+	if (o == NULL)
+		return NULL;
+
+	o->u.buffer.target = target;
+	o->u.buffer.usage = usage;
+	o->u.buffer.size = size;
+	if (data) {
+		o->u.buffer.data = malloc(size);
+		if (o->u.buffer.data == NULL) {
+			gdt_gl_delete(o);
+			return NULL;
+		}
+		memcpy(o->u.buffer.data, data, size);
+	}
+
+	make(o);
+	return o;
+}
+
+void gdt_gl_buffer_data(globject_t o, const void* data, int32_t size) {
+	if (o->u.buffer.data && data && size == o->u.buffer.size) {
+		memcpy(o->u.buffer.data, data, size);
+	} else {
+		free(o->u.buffer.data);
+		o->u.buffer.data = NULL;
+		if (data && (o->u.buffer.data = malloc(size)) != NULL)
+			memcpy(o->u.buffer.data, data, size);
+	}
+	o->u.buffer.size = size;
+
+	// Made from the new contents anyway if it is lost
+	if (!o->lost && o->name) {
+		glBindBuffer(o->u.buffer.target, o->name);
+		glBufferData(o->u.buffer.target, size, data, o->u.buffer.usage);
+	}
+}
+
+void gdt_gl_buffer_stream(globject_t o, const void* data, int32_t size) {
+	free(o->u.buffer.data);
+	o->u.buffer.data = NULL;
+	if (size > o->u.buffer.size)
+		o->u.buffer.size = size;
+
+	glBindBuffer(o->u.buffer.target, gdt_gl_name(o));
+	glBufferData(o->u.buffer.target, o->u.buffer.size, NULL, o->u.buffer.usage);
+	glBufferSubData(o->u.buffer.target, 0, size, data);
+}
+
+static bool has_mapbuffer(void) {
+	if (_mapbuffer < 0) {
+		const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+		_mapbuffer = extensions && strstr(extensions, "GL_OES_mapbuffer") ? 1 : 0;
+#ifdef GDT_PLATFORM_ANDROID
+		// Not exported by every libGLESv2 the game could be linked against
+		_mapBuffer = (PFNGLMAPBUFFEROESPROC)eglGetProcAddress("glMapBufferOES");
+		_unmapBuffer = (PFNGLUNMAPBUFFEROESPROC)eglGetProcAddress("glUnmapBufferOES");
+#else
+		_mapBuffer = glMapBufferOES;
+		_unmapBuffer = glUnmapBufferOES;
+#endif
+		if (_mapBuffer == NULL || _unmapBuffer == NULL)
+			_mapbuffer = 0;
+		gdt_log(LOG_NORMAL, TAG, "buffer mapping %s", _mapbuffer ? "available" : "not available, streaming with copies");
+	}
+	return _mapbuffer != 0;
+}
+
+void* gdt_gl_buffer_map(globject_t o, int32_t size) {
+	if (!has_mapbuffer())
+		return NULL;
+
+	free(o->u.buffer.data);
+	o->u.buffer.data = NULL;
+	if (size > o->u.buffer.size)
+		o->u.buffer.size = size;
+
+	glBindBuffer(o->u.buffer.target, gdt_gl_name(o));
+	glBufferData(o->u.buffer.target, o->u.buffer.size, NULL, o->u.buffer.usage);
+	return _mapBuffer(o->u.buffer.target, GL_WRITE_ONLY_OES);
+}
+
+bool gdt_gl_buffer_unmap(globject_t o) {
+	if (_mapbuffer != 1)
+		return false; // gdt_gl_buffer_map() returned NULL, there is nothing to unmap
+
+	glBindBuffer(o->u.buffer.target, gdt_gl_name(o));
+	return _unmapBuffer(o->u.buffer.target) == GL_TRUE;
+}
+
+globject_t gdt_gl_program(string_t vertexSource, string_t fragmentSource,
+                          const string_t* attributes, int32_t attributeCount, int32_t priority) {
+	globject_t o = add(GLOBJECT_PROGRAM, make_program, priority);
+	if (o == NULL)
+		return NULL;
+
+	o->u.program.vertexSource = strdup(vertexSource);
+	o->u.program.fragmentSource = strdup(fragmentSource);
+	o->u.program.attributes = (char**)calloc(attributeCount ? attributeCount : 1, sizeof(char*));
+	o->u.program.attributeCount = attributeCount;
+
+	int32_t i;
+	for (i = 0; i < attributeCount; i++)
+		o->u.program.attributes[i] = strdup(attributes[i]);
+
+	make(o);
+	if (o->name == 0) {
+		gdt_gl_delete(o);
+		return NULL;
+	}
+	return o;
+}
+
+globject_t gdt_gl_custom(globject_type_t type, glrecipe_t recipe, void* data, int32_t priority) {
+	globject_t o = add(type, make_custom, priority);
+	if (o == NULL)
+		return NULL;
+
+	o->u.custom.recipe = recipe;
+	o->u.custom.data = data;
+
+	make(o);
+	if (o->name == 0) {
+		gdt_gl_delete(o);
+		return NULL;
+	}
+	return o;
+}
+
+GLuint gdt_gl_name(globject_t o) {
+	if (o->lost)
+		make(o);
+	return o->name;
+}
+
+bool gdt_gl_ready(globject_t o) {
+	return !o->lost && o->name != 0;
+}
+
+uint32_t gdt_gl_generation(globject_t o) {
+	return o->generation;
+}
+
+void gdt_gl_delete(globject_t o) {
+	delete_name(o);
+
+	int32_t i;
+	for (i = _restoreNext; i < _restoreCount; i++)
+		if (_restore[i] == o)
+			_restore[i] = NULL;
+
+	_objects[o->index] = _objects[--_objectCount];
+	_objects[o->index]->index = o->index;
+
+	switch (o->type) {
+		case GLOBJECT_TEXTURE:
+			if (o->make == make_texture)
+				free(o->u.texture.path);
+			break;
+		case GLOBJECT_BUFFER:
+			if (o->make == make_buffer)
+				free(o->u.buffer.data);
+			break;
+		case GLOBJECT_PROGRAM:
+			if (o->make == make_program) {
+				for (i = 0; i < o->u.program.attributeCount; i++)
+					free(o->u.program.attributes[i]);
+				free(o->u.program.attributes);
+				free(o->u.program.vertexSource);
+				free(o->u.program.fragmentSource);
+			}
+			break;
+	}
+	free(o);
+}
+
+int32_t gdt_gl_pending(void) {
+	int32_t i, n = 0;
+	for (i = _restoreNext; i < _restoreCount; i++)
+		if (_restore[i] && _restore[i]->lost)
+			n++;
+	return n;
+}
+
+void gdt_gl_set_restore_budget(uint64_t ns) {
+	_budget = ns;
+}
+
+
+
+void gdt_gl_context_lost(void) {
+	_mapbuffer = -1;
+	if (_objectCount == 0)
+		return;
+
+	globject_t* restore = (globject_t*)realloc(_restore, _objectCount * sizeof(globject_t));
+	if (restore == NULL) {
+		gdt_log(LOG_ERROR, TAG, "out of memory, objects will only be restored when used");
+		_restoreCount = _restoreNext = 0;
+	} else {
+		_restore = restore;
+		memcpy(_restore, _objects, _objectCount * sizeof(globject_t));
+		qsort(_restore, _objectCount, sizeof(globject_t), by_priority);
+		_restoreCount = _objectCount;
+		_restoreNext = 0;
+	}
+
+	// The names died with the old context, there is nothing to delete
+	int32_t i;
+	for (i = 0; i < _objectCount; i++) {
+		_objects[i]->name = 0;
+		_objects[i]->lost = true;
+	}
+}
+
+void gdt_gl_restore(uint64_t start) {
+	bool first = true;
+
+	// Read once for all the objects made this frame, and only if there are any
+	gdt_gl_keep_bindings_begin();
+	while (_restoreNext < _restoreCount) {
+		if (!first && gdt_time_ns() - start >= _budget)
+			break;
+
+		globject_t o = _restore[_restoreNext++];
+		if (o && o->lost) {
+			make(o);
+			first = false;
+		}
+	}
+	gdt_gl_keep_bindings_end();
+}
@@ -0,0 +1,172 @@
+/*
+ * gdt_internal.h
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef gdt_internal_h
+#define gdt_internal_h
+
+#include <gdt/gdt.h>
+
+/* --- Runtime internals ---
+ *  Shared between gdt_common.c and the platform backends,
+ *  not part of the public API.
+ */
+
+// The backends call these instead of the corresponding hooks directly
+void gdt_common_render(void);
+void gdt_common_visible(bool newContext);
+void gdt_common_hidden(void);
+
+// Input and lifecycle events, run right away or queued for the simulation thread
+void gdt_common_touch(touchhandler_t cb, touch_type_t what, int x, int y);
+void gdt_common_text(texthandler_t cb, string_t text);
+void gdt_common_accelerometer(accelerometerhandler_t cb, accelerometer_data_t* data);
+void gdt_common_active(void);
+void gdt_common_inactive(void);
+void gdt_common_save_state(void);
+
+/* Implemented by the backends, called first and last on threads started
+ * by gdt that call back into the game (e.g. to attach the JNI environment).
+ */
+void gdt_platform_thread_begin(void);
+void gdt_platform_thread_end(void);
+
+
+// --- Directory-backed resources (gdt_resource_dir.c) ---
+
+/* gdt_resource_dir_map -- Map resourcePath from the directory set with
+ * gdt_resource_set_directory(). Returns NULL if no directory is set or
+ * the file could not be mapped, in which case the backend falls back to
+ * the bundled resources. The bytes are a copy of the file, so it can be
+ * rewritten in place meanwhile. The mapping is released with munmap().
+ */
+void* gdt_resource_dir_map(string_t resourcePath, int32_t* length);
+
+// Dispatch pending change notifications, called once per frame
+void gdt_resource_dir_poll(void);
+
+
+// --- Resource prefetch (gdt_prefetch.c) ---
+
+// Begin the built-in "launch" phase, the backends call it before gdt_hook_initialize()
+void gdt_prefetch_launch(void);
+
+// True while a phase is being recorded, to skip looking up what to note otherwise
+bool gdt_prefetch_recording(void);
+
+/* gdt_prefetch_note -- The backends call it for every resource they load,
+ * with the file it is mapped from and where in that file it is.
+ */
+void gdt_prefetch_note(string_t file, int64_t offset, int64_t length);
+
+// Ends the launch phase once it has run its time, called once per frame
+void gdt_prefetch_poll(uint64_t now);
+
+
+// --- Timers and coroutines (gdt_timer.c) ---
+
+// Advance the game clock to time (gdt_time_ns() clock), fire due timers and resume coroutines
+void gdt_timer_advance(uint64_t time);
+
+// Called when hidden, the time until the next gdt_timer_advance() does not count
+void gdt_timer_pause(void);
+
+
+// --- GL object registry (gdt_gles2.c) ---
+
+// Called before gdt_hook_visible(true), every registered object has to be made again
+void gdt_gl_context_lost(void);
+
+// Restore lost objects for the restore budget, counted from start
+void gdt_gl_restore(uint64_t start);
+
+/* The library binds textures and buffers of its own, and sets
+ * GL_UNPACK_ALIGNMENT, where the game does not expect it to: when making
+ * objects, restoring them and streaming texture levels. Such code runs
+ * between gdt_gl_keep_bindings_begin() and _end(), and calls
+ * gdt_gl_bindings_changing() before it changes any of them. The active
+ * texture unit, its GL_TEXTURE_2D binding, both buffer bindings and the
+ * unpack alignment are then read once and put back by the outermost
+ * _end(), so frames that change nothing cost no glGet.
+ */
+void gdt_gl_keep_bindings_begin(void);
+void gdt_gl_bindings_changing(void);
+void gdt_gl_keep_bindings_end(void);
+
+
+// --- Texture streaming (gdt_texture.c) ---
+
+// Bring in the detail needed last frame and keep to the budget, called once per frame
+void gdt_texture_update(uint64_t start);
+
+
+// --- Frame statistics (gdt_frame_stats.c) ---
+
+// Record a frame that started rendering at start and finished at end
+void gdt_frame_stats_record(uint64_t start, uint64_t end);
+
+// Called when hidden, the next frame does not get an interval
+void gdt_frame_stats_pause(void);
+
+
+
+// --- Startup (gdt_startup.c) ---
+
+// Mark a phase that happened at time (gdt_time_ns() clock), possibly in the past
+void gdt_startup_mark_at(string_t phase, uint64_t time);
+
+void gdt_startup_frame_rendered(void);
+
+// Idempotent, the backends call it when a frame is known to be on screen
+void gdt_startup_frame_presented(void);
+
+// Run deferred work for up to a couple of milliseconds from start
+void gdt_startup_run_deferred(uint64_t start);
+
+
+// --- Simulation thread (gdt_sim.c) ---
+
+typedef enum {
+	SIM_HOOK_ACTIVE,
+	SIM_HOOK_INACTIVE,
+	SIM_HOOK_SAVE_STATE
+} sim_hook_t;
+
+/* Queue an event for the simulation thread. They all return false, without
+ * queuing anything, if gdt_sim_start() has not been called.
+ * gdt_sim_post_hook(SIM_HOOK_SAVE_STATE) waits until the hook has returned.
+ */
+bool gdt_sim_post_touch(touchhandler_t cb, touch_type_t what, int x, int y);
+bool gdt_sim_post_text(texthandler_t cb, string_t text);
+bool gdt_sim_post_accelerometer(accelerometerhandler_t cb, accelerometer_data_t* data);
+bool gdt_sim_post_hook(sim_hook_t hook);
+
+// Stepping is paused while not visible
+void gdt_sim_set_visible(bool visible);
+
+/* Whether gdt_sim_start() has started the thread. Only meaningful once
+ * gdt_hook_initialize() has returned, on the thread that called it.
+ */
+bool gdt_sim_running(void);
+
+#endif // gdt_internal_h
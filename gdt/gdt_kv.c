@@ -0,0 +1,633 @@
+/*
+ * gdt_kv.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gdt/gdt_kv.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static string_t TAG = "gdt_kv";
+
+/* File layout:
+ *   "GDTKV001" and 8 reserved bytes
+ *   records, each 8 byte aligned:
+ *     record_t
+ *     value, padded to 8 bytes (left out for deletes)
+ *     key, padded to 8 bytes
+ *   zeroes up to the end of the file
+ * The CRC covers everything in the record after the crc field itself.
+ */
+#define MAGIC "GDTKV001"
+#define FILE_HEADER 16
+#define DEFAULT_MAX_BYTES (16 << 20)
+#define GROW_BYTES (64 << 10)
+#define MIN_COMPACT_BYTES (64 << 10)
+#define DELETED 0xffffffffu
+
+typedef struct {
+	uint32_t crc;
+	uint32_t value_length; // DELETED for deletes
+	uint16_t key_length;
+	uint16_t reserved0;
+	uint32_t reserved1;
+} record_t;
+
+// offset 0 marks an empty slot, no record can start there
+typedef struct {
+	uint32_t hash;
+	uint32_t offset;
+} slot_t;
+
+typedef enum {
+	COMPACT_IDLE,
+	COMPACT_RUNNING,
+	COMPACT_DONE,
+	COMPACT_FAILED
+} compact_state_t;
+
+struct kvstore {
+	char* path;
+	int fd;
+	uint8_t* map;
+	uint32_t reserved; // length of the mapping
+	uint32_t size;     // of the file
+	uint32_t end;      // of the log
+	uint32_t synced;   // end of the log at the last sync
+	uint32_t live;     // bytes of the records in the index
+
+	slot_t* slots;
+	uint32_t slotCount; // power of two
+	int32_t count;
+
+	pthread_t compactor;
+	int compacting; // compact_state_t, shared with the compactor
+	uint32_t* snapshot; // offsets of the live records when compaction started
+	uint32_t snapshotCount;
+	uint32_t snapshotEnd;
+};
+
+static uint32_t crcTable[256];
+
+
+static uint32_t crc32(const uint8_t* p, size_t n, uint32_t crc) {
+	if (crcTable[1] == 0) {
+		uint32_t i, j;
+		for (i = 0; i < 256; i++) {
+			uint32_t c = i;
+			for (j = 0; j < 8; j++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			crcTable[i] = c;
+		}
+	}
+
+	crc = ~crc;
+	while (n--)
+		crc = crcTable[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static uint32_t pad8(uint32_t n) {
+	return (n + 7) & ~7u;
+}
+
+static uint32_t hash_key(const uint8_t* key, uint32_t len) {
+	uint32_t h = 2166136261u; // FNV-1a
+	while (len--)
+		h = (h ^ *key++) * 16777619u;
+	return h;
+}
+
+static record_t* record_at(kvstore_t kv, uint32_t offset) {
+	return (record_t*)(kv->map + offset);
+}
+
+static uint32_t record_size(const record_t* r) {
+	uint32_t value = r->value_length == DELETED ? 0 : pad8(r->value_length);
+	return sizeof(record_t) + value + pad8(r->key_length);
+}
+
+static const uint8_t* record_key(const record_t* r) {
+	uint32_t value = r->value_length == DELETED ? 0 : pad8(r->value_length);
+	return (const uint8_t*)r + sizeof(record_t) + value;
+}
+
+
+
+// --- Index, open addressing with linear probing ---
+
+static int64_t index_find(kvstore_t kv, const uint8_t* key, uint32_t len, uint32_t hash) {
+	if (kv->slotCount == 0)
+		return -1;
+
+	uint32_t mask = kv->slotCount - 1;
+	uint32_t i = hash & mask;
+
+	for (; kv->slots[i].offset; i = (i + 1) & mask) {
+		if (kv->slots[i].hash != hash)
+			continue;
+
+		const record_t* r = record_at(kv, kv->slots[i].offset);
+		if (r->key_length == len && memcmp(record_key(r), key, len) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+static bool index_grow(kvstore_t kv) {
+	uint32_t count = kv->slotCount ? 2 * kv->slotCount : 256;
+	slot_t* slots = (slot_t*)calloc(count, sizeof(slot_t));
+	if (slots == NULL)
+		return false;
+
+	uint32_t i;
+	for (i = 0; i < kv->slotCount; i++) {
+		slot_t s = kv->slots[i];
+		if (s.offset == 0)
+			continue;
+
+		uint32_t j = s.hash & (count - 1);
+		while (slots[j].offset)
+			j = (j + 1) & (count - 1);
+		slots[j] = s;
+	}
+
+	free(kv->slots);
+	kv->slots = slots;
+	kv->slotCount = count;
+	return true;
+}
+
+static bool index_insert(kvstore_t kv, uint32_t hash, uint32_t offset) {
+	if (2 * (uint32_t)(kv->count + 1) > kv->slotCount && !index_grow(kv))
+		return false;
+
+	uint32_t mask = kv->slotCount - 1;
+	uint32_t i = hash & mask;
+	while (kv->slots[i].offset)
+		i = (i + 1) & mask;
+
+	kv->slots[i].hash = hash;
+	kv->slots[i].offset = offset;
+	kv->count++;
+	return true;
+}
+
+static void index_remove(kvstore_t kv, uint32_t i) {
+	uint32_t mask = kv->slotCount - 1;
+	uint32_t j = i;
+
+	// Shift back the entries after the hole that would otherwise no longer be found
+	for (;;) {
+		kv->slots[i].offset = 0;
+
+		uint32_t home;
+		do {
+			j = (j + 1) & mask;
+			if (kv->slots[j].offset == 0) {
+				kv->count--;
+				return;
+			}
+			home = kv->slots[j].hash & mask;
+		} while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+
+		kv->slots[i] = kv->slots[j];
+		i = j;
+	}
+}
+
+// Make the index reflect the record at offset
+static bool apply(kvstore_t kv, uint32_t offset) {
+	const record_t* r = record_at(kv, offset);
+	const uint8_t* key = record_key(r);
+	uint32_t hash = hash_key(key, r->key_length);
+	int64_t i = index_find(kv, key, r->key_length, hash);
+
+	if (i >= 0) {
+		kv->live -= record_size(record_at(kv, kv->slots[i].offset));
+		if (r->value_length == DELETED) {
+			index_remove(kv, (uint32_t)i);
+		} else {
+			kv->slots[i].offset = offset;
+			kv->live += record_size(r);
+		}
+		return true;
+	}
+
+	if (r->value_length == DELETED)
+		return true;
+
+	if (!index_insert(kv, hash, offset))
+		return false;
+	kv->live += record_size(r);
+	return true;
+}
+
+
+
+// --- File ---
+
+static bool set_size(kvstore_t kv, uint32_t size) {
+	if (ftruncate(kv->fd, size) == -1) {
+		gdt_log(LOG_WARNING, TAG, "could not resize %s (%s)", kv->path, strerror(errno));
+		return false;
+	}
+	kv->size = size;
+	return true;
+}
+
+static void scan(kvstore_t kv) {
+	uint32_t offset = FILE_HEADER;
+
+	while (offset + sizeof(record_t) <= kv->size) {
+		const record_t* r = record_at(kv, offset);
+		if (r->key_length == 0)
+			break; // the zeroes after the log
+
+		uint32_t size = record_size(r);
+		if (offset + size > kv->size ||
+		    crc32((const uint8_t*)r + 4, size - 4, 0) != r->crc) {
+			gdt_log(LOG_WARNING, TAG, "%s: dropping a torn record at %u", kv->path, offset);
+			break;
+		}
+
+		if (!apply(kv, offset))
+			break;
+		offset += size;
+	}
+
+	kv->end = offset;
+}
+
+static bool map_file(kvstore_t kv) {
+	kv->fd = open(kv->path, O_RDWR | O_CREAT, 0600);
+	if (kv->fd == -1) {
+		gdt_log(LOG_WARNING, TAG, "could not open %s (%s)", kv->path, strerror(errno));
+		return false;
+	}
+
+	struct stat info;
+	if (fstat(kv->fd, &info) == -1 || info.st_size > kv->reserved) {
+		gdt_log(LOG_WARNING, TAG, "%s is larger than the store allows", kv->path);
+		return false;
+	}
+	kv->size = info.st_size;
+
+	// The whole reservation is mapped now, the file grows into it
+	kv->map = (uint8_t*)mmap(NULL, kv->reserved, PROT_READ | PROT_WRITE, MAP_SHARED, kv->fd, 0);
+	if (kv->map == MAP_FAILED) {
+		kv->map = NULL;
+		gdt_log(LOG_WARNING, TAG, "could not map %s (%s)", kv->path, strerror(errno));
+		return false;
+	}
+
+	if (kv->size < FILE_HEADER || memcmp(kv->map, MAGIC, 8) != 0) {
+		if (kv->size)
+			gdt_log(LOG_WARNING, TAG, "%s is not a store, starting over", kv->path);
+		if (!set_size(kv, 0) || !set_size(kv, GROW_BYTES))
+			return false;
+		memcpy(kv->map, MAGIC, 8);
+	}
+
+	scan(kv);
+
+	// Zero whatever follows the log, so that the next records land on a clean slate
+	uint32_t clean = (kv->end + GROW_BYTES - 1) / GROW_BYTES * GROW_BYTES;
+	if (kv->end < kv->size && (!set_size(kv, kv->end) || !set_size(kv, clean)))
+		return false;
+
+	kv->synced = kv->end;
+	return true;
+}
+
+static void unmap_file(kvstore_t kv) {
+	if (kv->map)
+		munmap(kv->map, kv->reserved);
+	if (kv->fd != -1)
+		close(kv->fd);
+
+	kv->map = NULL;
+	kv->fd = -1;
+	free(kv->slots);
+	kv->slots = NULL;
+	kv->slotCount = 0;
+	kv->count = 0;
+	kv->live = 0;
+}
+
+
+
+// --- Compaction ---
+
+static char* compact_path(kvstore_t kv) {
+	char* s;
+	if (asprintf(&s, "%s.compact", kv->path) == -1)
+		return NULL;
+	return s;
+}
+
+static bool write_all(int fd, const void* p, size_t n) {
+	const uint8_t* b = (const uint8_t*)p;
+	while (n) {
+		ssize_t w = write(fd, b, n);
+		if (w == -1 && errno == EINTR)
+			continue;
+		if (w <= 0)
+			return false;
+		b += w;
+		n -= w;
+	}
+	return true;
+}
+
+/* Runs on the compactor thread. It only reads records before snapshotEnd,
+ * which are never written again, while the owner keeps appending after it.
+ */
+static void* compact(void* arg) {
+	kvstore_t kv = (kvstore_t)arg;
+	int state = COMPACT_FAILED;
+	char* tmp = compact_path(kv);
+	int fd = tmp ? open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600) : -1;
+
+	if (fd != -1) {
+		uint8_t header[FILE_HEADER] = { 0 };
+		memcpy(header, MAGIC, 8);
+
+		bool ok = write_all(fd, header, sizeof(header));
+		uint32_t i;
+		for (i = 0; ok && i < kv->snapshotCount; i++) {
+			const record_t* r = record_at(kv, kv->snapshot[i]);
+			ok = write_all(fd, r, record_size(r));
+		}
+
+		if (ok && fsync(fd) == 0)
+			state = COMPACT_DONE;
+		close(fd);
+	}
+
+	free(tmp);
+	__atomic_store_n(&kv->compacting, state, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void compact_start(kvstore_t kv) {
+	if (__atomic_load_n(&kv->compacting, __ATOMIC_ACQUIRE) != COMPACT_IDLE)
+		return;
+
+	uint32_t* snapshot = (uint32_t*)malloc((kv->count + 1) * sizeof(uint32_t));
+	if (snapshot == NULL)
+		return;
+
+	// In log order, so the compacted log keeps the order of the writes
+	uint32_t i, n = 0;
+	for (i = 0; i < kv->slotCount; i++)
+		if (kv->slots[i].offset)
+			snapshot[n++] = kv->slots[i].offset;
+
+	uint32_t a, b;
+	for (a = 1; a < n; a++) {
+		uint32_t v = snapshot[a];
+		for (b = a; b > 0 && snapshot[b - 1] > v; b--)
+			snapshot[b] = snapshot[b - 1];
+		snapshot[b] = v;
+	}
+
+	kv->snapshot = snapshot;
+	kv->snapshotCount = n;
+	kv->snapshotEnd = kv->end;
+	kv->compacting = COMPACT_RUNNING;
+
+	if (pthread_create(&kv->compactor, NULL, compact, kv) != 0) {
+		kv->compacting = COMPACT_IDLE;
+		free(kv->snapshot);
+		kv->snapshot = NULL;
+	}
+}
+
+// Swap in the compacted log if it is ready, or wait for it if wait is set
+static void compact_finish(kvstore_t kv, bool wait) {
+	int state = __atomic_load_n(&kv->compacting, __ATOMIC_ACQUIRE);
+	if (state == COMPACT_IDLE || (state == COMPACT_RUNNING && !wait))
+		return;
+
+	pthread_join(kv->compactor, NULL);
+	state = kv->compacting;
+	kv->compacting = COMPACT_IDLE;
+	free(kv->snapshot);
+	kv->snapshot = NULL;
+
+	char* tmp = compact_path(kv);
+	if (tmp == NULL)
+		return;
+
+	if (state == COMPACT_DONE) {
+		// Whatever was written since the snapshot goes after it, in order
+		int fd = open(tmp, O_WRONLY | O_APPEND);
+		bool ok = fd != -1 &&
+		          write_all(fd, kv->map + kv->snapshotEnd, kv->end - kv->snapshotEnd) &&
+		          fsync(fd) == 0;
+		if (fd != -1)
+			close(fd);
+
+		if (ok && rename(tmp, kv->path) == 0) {
+			uint32_t before = kv->end;
+			unmap_file(kv);
+			if (map_file(kv)) {
+				gdt_log(LOG_DEBUG, TAG, "compacted %s from %u to %u bytes", kv->path, before, kv->end);
+			} else {
+				gdt_log(LOG_ERROR, TAG, "could not reopen %s after compaction", kv->path);
+				unmap_file(kv);
+			}
+			free(tmp);
+			return;
+		}
+	}
+
+	gdt_log(LOG_WARNING, TAG, "compaction of %s failed", kv->path);
+	unlink(tmp);
+	free(tmp);
+}
+
+static void maybe_compact(kvstore_t kv) {
+	uint32_t dead = kv->end - FILE_HEADER - kv->live;
+	if (dead > kv->live && dead > MIN_COMPACT_BYTES)
+		compact_start(kv);
+}
+
+
+
+// --- Writing ---
+
+static bool reserve(kvstore_t kv, uint32_t bytes) {
+	if (kv->end + bytes <= kv->size)
+		return true;
+
+	uint64_t size = ((uint64_t)kv->end + bytes + GROW_BYTES - 1) / GROW_BYTES * GROW_BYTES;
+	if (size <= kv->reserved)
+		return set_size(kv, (uint32_t)size);
+
+	// Out of room, compaction is the only way to make some
+	if (__atomic_load_n(&kv->compacting, __ATOMIC_ACQUIRE) == COMPACT_IDLE)
+		compact_start(kv);
+	compact_finish(kv, true);
+
+	if (kv->map == NULL)
+		return false;
+
+	size = ((uint64_t)kv->end + bytes + GROW_BYTES - 1) / GROW_BYTES * GROW_BYTES;
+	return size <= kv->reserved && set_size(kv, (uint32_t)size);
+}
+
+static bool append(kvstore_t kv, string_t key, uint32_t keyLength, const void* value, uint32_t valueLength) {
+	uint32_t valueBytes = valueLength == DELETED ? 0 : pad8(valueLength);
+	uint64_t size = sizeof(record_t) + (uint64_t)valueBytes + pad8(keyLength);
+
+	if (size > kv->reserved || !reserve(kv, (uint32_t)size))
+		return false;
+
+	// The space after the log is all zeroes, so the padding already is
+	record_t* r = record_at(kv, kv->end);
+	r->value_length = valueLength;
+	r->key_length = keyLength;
+	if (valueBytes)
+		memcpy((uint8_t*)r + sizeof(record_t), value, valueLength);
+	memcpy((uint8_t*)r + sizeof(record_t) + valueBytes, key, keyLength);
+
+	// Written last, a record cut short by a crash will not check out
+	r->crc = crc32((const uint8_t*)r + 4, (uint32_t)size - 4, 0);
+
+	uint32_t offset = kv->end;
+	kv->end += (uint32_t)size;
+	if (!apply(kv, offset))
+		return false;
+
+	maybe_compact(kv);
+	return true;
+}
+
+
+
+kvstore_t gdt_kv_open(string_t name, int32_t maxBytes) {
+	kvstore_t kv = (kvstore_t)calloc(1, sizeof(struct kvstore));
+	if (kv == NULL)
+		return NULL;
+
+	kv->fd = -1;
+	kv->reserved = maxBytes > 0 ? (uint32_t)maxBytes : DEFAULT_MAX_BYTES;
+	kv->reserved = (kv->reserved + GROW_BYTES - 1) / GROW_BYTES * GROW_BYTES;
+
+	if (asprintf(&kv->path, "%s/%s.kv", gdt_get_storage_directory_path(), name) == -1) {
+		free(kv);
+		return NULL;
+	}
+
+	// Left behind if the game was killed while compacting, the log itself is intact
+	char* tmp = compact_path(kv);
+	if (tmp) {
+		unlink(tmp);
+		free(tmp);
+	}
+
+	if (!map_file(kv)) {
+		unmap_file(kv);
+		free(kv->path);
+		free(kv);
+		return NULL;
+	}
+
+	return kv;
+}
+
+void gdt_kv_close(kvstore_t kv) {
+	compact_finish(kv, true);
+	unmap_file(kv);
+	free(kv->path);
+	free(kv);
+}
+
+const void* gdt_kv_get(kvstore_t kv, string_t key, int32_t* valueLength) {
+	if (kv->map == NULL)
+		return NULL;
+
+	uint32_t len = strlen(key);
+	int64_t i = index_find(kv, (const uint8_t*)key, len, hash_key((const uint8_t*)key, len));
+	if (i < 0)
+		return NULL;
+
+	const record_t* r = record_at(kv, kv->slots[i].offset);
+	if (valueLength)
+		*valueLength = r->value_length;
+	return (const uint8_t*)r + sizeof(record_t);
+}
+
+bool gdt_kv_put(kvstore_t kv, string_t key, const void* value, int32_t valueLength) {
+	compact_finish(kv, false);
+
+	size_t len = strlen(key);
+	if (kv->map == NULL || len == 0 || len > 0xffff || valueLength < 0)
+		return false;
+
+	int32_t oldLength;
+	const void* old = gdt_kv_get(kv, key, &oldLength);
+	if (old && oldLength == valueLength && memcmp(old, value, valueLength) == 0)
+		return true;
+
+	return append(kv, key, len, value, valueLength);
+}
+
+bool gdt_kv_delete(kvstore_t kv, string_t key) {
+	compact_finish(kv, false);
+
+	if (kv->map == NULL || gdt_kv_get(kv, key, NULL) == NULL)
+		return kv->map != NULL;
+
+	return append(kv, key, strlen(key), NULL, DELETED);
+}
+
+int32_t gdt_kv_count(kvstore_t kv) {
+	return kv->count;
+}
+
+bool gdt_kv_sync(kvstore_t kv) {
+	compact_finish(kv, false);
+
+	if (kv->map == NULL)
+		return false;
+	if (kv->synced == kv->end)
+		return true;
+
+	uint32_t page = sysconf(_SC_PAGESIZE);
+	uint32_t from = kv->synced / page * page;
+
+	bool ok = msync(kv->map + from, kv->end - from, MS_SYNC) == 0 && fsync(kv->fd) == 0;
+	if (ok)
+		kv->synced = kv->end;
+	return ok;
+}
@@ -0,0 +1,105 @@
+/*
+ * gdt_mesh.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gdt/gdt_mesh.h>
+#include <stddef.h>
+
+static string_t TAG = "gdt_mesh";
+
+
+static int index_size(uint32_t type) {
+	switch (type) {
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		case GL_UNSIGNED_SHORT:
+			return 2;
+		default:
+			return 0;
+	}
+}
+
+bool gdt_mesh_open(resource_t resource, mesh_t* mesh) {
+	const uint8_t* bytes = (const uint8_t*)gdt_resource_bytes(resource);
+	uint32_t length = gdt_resource_length(resource);
+	const mesh_header_t* h = (const mesh_header_t*)bytes;
+
+	if (length < sizeof(mesh_header_t) || h->magic != GDT_MESH_MAGIC) {
+		gdt_log(LOG_WARNING, TAG, "not a mesh");
+		return false;
+	}
+	if (h->version != GDT_MESH_VERSION) {
+		gdt_log(LOG_WARNING, TAG, "unsupported mesh version %u", h->version);
+		return false;
+	}
+
+	uint64_t vertexBytes = (uint64_t)h->vertex_count * h->vertex_stride;
+	uint64_t indexBytes = (uint64_t)h->index_count * index_size(h->index_type);
+
+	if (index_size(h->index_type) == 0 || h->attribute_count > GDT_MESH_MAX_ATTRIBUTES ||
+	    h->vertex_offset + vertexBytes > length || h->index_offset + indexBytes > length) {
+		gdt_log(LOG_WARNING, TAG, "corrupt mesh");
+		return false;
+	}
+
+	mesh->header = h;
+	mesh->vertices = bytes + h->vertex_offset;
+	mesh->indices = bytes + h->index_offset;
+	mesh->vertex_bytes = (int32_t)vertexBytes;
+	mesh->index_bytes = (int32_t)indexBytes;
+	return true;
+}
+
+const mesh_attribute_t* gdt_mesh_attribute(const mesh_t* mesh, mesh_semantic_t semantic) {
+	uint32_t i;
+	for (i = 0; i < mesh->header->attribute_count; i++)
+		if (mesh->header->attributes[i].semantic == semantic)
+			return &mesh->header->attributes[i];
+	return NULL;
+}
+
+void gdt_mesh_upload(const mesh_t* mesh, GLuint vertexBuffer, GLuint indexBuffer) {
+	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh->vertex_bytes, mesh->vertices, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh->index_bytes, mesh->indices, GL_STATIC_DRAW);
+}
+
+void gdt_mesh_bind(const mesh_t* mesh, const GLint locations[MESH_SEMANTIC_COUNT]) {
+	uint32_t i;
+	for (i = 0; i < mesh->header->attribute_count; i++) {
+		const mesh_attribute_t* a = &mesh->header->attributes[i];
+		if (a->semantic >= MESH_SEMANTIC_COUNT || locations[a->semantic] < 0)
+			continue;
+
+		GLuint location = locations[a->semantic];
+		glEnableVertexAttribArray(location);
+		glVertexAttribPointer(location, a->size, a->type, a->normalized ? GL_TRUE : GL_FALSE,
+		                      mesh->header->vertex_stride, (const void*)(uintptr_t)a->offset);
+	}
+}
+
+void gdt_mesh_draw(const mesh_t* mesh) {
+	glDrawElements(mesh->header->primitive, mesh->header->index_count, mesh->header->index_type, NULL);
+}
@@ -0,0 +1,707 @@
+/*
+ * gdt_particles.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gdt/gdt_particles.h>
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef GDT_PARTICLES_HEADLESS
+#include "gdt_internal.h"
+#endif
+
+#if defined(GDT_PARTICLES_SCALAR)
+#define SIMD "scalar"
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define SIMD "neon"
+#define USE_NEON
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define SIMD "sse2"
+#define USE_SSE2
+#include <emmintrin.h>
+#else
+#define SIMD "scalar"
+#endif
+
+#define MAX_THREADS 8
+#define MIN_GROUPS_PER_THREAD 1024 // below 4096 particles a thread costs more than it saves
+#define MAX_QUADS 16384            // per draw call, the most 16 bit indices reach
+
+// Texture coordinates of the corners as u | v << 8, counter-clockwise from the bottom left
+#define UV0 0x0000
+#define UV1 0x00ff
+#define UV2 0xffff
+#define UV3 0xff00
+
+/* Particles are stored an attribute per array, each 16 byte aligned and
+ * with room for a multiple of four, so the kernels can take a group of
+ * four at a time. Past count, up to the next multiple of four, are left
+ * over particles (or zeros), the kernels go through them as well.
+ */
+struct emitter {
+	emitter_params_t params;
+	float x;
+	float y;
+	int32_t count;
+	int32_t capacity; // a multiple of 4
+	int32_t burst;
+	float debt;       // fractional particles owed by the rate
+	uint32_t random;
+
+	void* block;
+	float* px;
+	float* py;
+	float* vx;
+	float* vy;
+	float* age;
+	float* invLife;   // dead once age * invLife reaches 1
+};
+
+// What the kernels need that is the same for every particle of a call
+typedef struct {
+	float dt;
+	float damping;
+	float dvx;
+	float dvy;
+} motion_t;
+
+typedef struct {
+	float halfSize;
+	float halfSizeDelta;
+	float color[4];      // r, g, b, a, 0 to 255 plus 0.5 for rounding
+	float colorDelta[4];
+} look_t;
+
+typedef enum {
+	JOB_UPDATE,
+	JOB_WRITE
+} job_type_t;
+
+typedef struct {
+	job_type_t type;
+	emitter_t e;
+	const void* consts;   // motion_t or look_t
+	particle_vertex_t* vertices;
+	int32_t groups;
+	int32_t parts;        // the caller does part 0, worker i part i + 1
+} job_t;
+
+static pthread_t _threads[MAX_THREADS];
+static int32_t _threadCount = 0;
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _done = PTHREAD_COND_INITIALIZER;
+static job_t _job;
+static uint32_t _jobSeq = 0;
+static uint32_t _startSeq = 0; // _jobSeq when the workers were started
+static int32_t _pending = 0;
+static bool _quit = false;
+
+// --- Kernels ---
+// Each does groups [first, end) of four particles.
+
+static void put(particle_vertex_t* v, float x, float y, uint32_t color, uint32_t uv) {
+	uint32_t words[4];
+	memcpy(&words[0], &x, 4);
+	memcpy(&words[1], &y, 4);
+	words[2] = color;
+	words[3] = uv;
+	memcpy(v, words, sizeof(words));
+}
+
+#if defined(USE_NEON)
+
+static void update_groups(emitter_t e, const motion_t* m, int32_t first, int32_t end) {
+	float32x4_t dt = vdupq_n_f32(m->dt);
+	float32x4_t damping = vdupq_n_f32(m->damping);
+	float32x4_t dvx = vdupq_n_f32(m->dvx);
+	float32x4_t dvy = vdupq_n_f32(m->dvy);
+	int32_t i;
+	for (i = 4 * first; i < 4 * end; i += 4) {
+		float32x4_t vx = vmlaq_f32(dvx, vld1q_f32(e->vx + i), damping);
+		float32x4_t vy = vmlaq_f32(dvy, vld1q_f32(e->vy + i), damping);
+		vst1q_f32(e->vx + i, vx);
+		vst1q_f32(e->vy + i, vy);
+		vst1q_f32(e->px + i, vmlaq_f32(vld1q_f32(e->px + i), vx, dt));
+		vst1q_f32(e->py + i, vmlaq_f32(vld1q_f32(e->py + i), vy, dt));
+		vst1q_f32(e->age + i, vaddq_f32(vld1q_f32(e->age + i), dt));
+	}
+}
+
+static void write_groups(emitter_t e, const look_t* l, particle_vertex_t* vertices, int32_t first, int32_t end) {
+	float32x4_t halfSize = vdupq_n_f32(l->halfSize);
+	float32x4_t halfSizeDelta = vdupq_n_f32(l->halfSizeDelta);
+	float32x4_t zero = vdupq_n_f32(0.0f);
+	float32x4_t one = vdupq_n_f32(1.0f);
+	float32x4_t uv0 = vreinterpretq_f32_u32(vdupq_n_u32(UV0));
+	float32x4_t uv1 = vreinterpretq_f32_u32(vdupq_n_u32(UV1));
+	float32x4_t uv2 = vreinterpretq_f32_u32(vdupq_n_u32(UV2));
+	float32x4_t uv3 = vreinterpretq_f32_u32(vdupq_n_u32(UV3));
+	int32_t g;
+	for (g = first; g < end; g++) {
+		int32_t i = 4 * g;
+		float32x4_t x = vld1q_f32(e->px + i);
+		float32x4_t y = vld1q_f32(e->py + i);
+		float32x4_t t = vmulq_f32(vld1q_f32(e->age + i), vld1q_f32(e->invLife + i));
+		t = vminq_f32(vmaxq_f32(t, zero), one);
+		float32x4_t h = vmlaq_f32(halfSize, halfSizeDelta, t);
+
+		uint32x4_t c = vdupq_n_u32(0);
+		int k;
+		for (k = 0; k < 4; k++) {
+			float32x4_t channel = vmlaq_f32(vdupq_n_f32(l->color[k]), vdupq_n_f32(l->colorDelta[k]), t);
+			c = vorrq_u32(c, vshlq_u32(vcvtq_u32_f32(channel), vdupq_n_s32(8 * k)));
+		}
+
+		// Each store interleaves one corner of the four particles into four vertices
+		float32x4x4_t corner;
+		float32x4_t left = vsubq_f32(x, h), right = vaddq_f32(x, h);
+		float32x4_t bottom = vsubq_f32(y, h), top = vaddq_f32(y, h);
+		float* out = (float*)(vertices + 16 * g);
+		corner.val[2] = vreinterpretq_f32_u32(c);
+		corner.val[0] = left;  corner.val[1] = bottom; corner.val[3] = uv0; vst4q_f32(out, corner);
+		corner.val[0] = right;                         corner.val[3] = uv1; vst4q_f32(out + 16, corner);
+		                       corner.val[1] = top;    corner.val[3] = uv2; vst4q_f32(out + 32, corner);
+		corner.val[0] = left;                          corner.val[3] = uv3; vst4q_f32(out + 48, corner);
+	}
+}
+
+#elif defined(USE_SSE2)
+
+static void update_groups(emitter_t e, const motion_t* m, int32_t first, int32_t end) {
+	__m128 dt = _mm_set1_ps(m->dt);
+	__m128 damping = _mm_set1_ps(m->damping);
+	__m128 dvx = _mm_set1_ps(m->dvx);
+	__m128 dvy = _mm_set1_ps(m->dvy);
+	int32_t i;
+	for (i = 4 * first; i < 4 * end; i += 4) {
+		__m128 vx = _mm_add_ps(_mm_mul_ps(_mm_load_ps(e->vx + i), damping), dvx);
+		__m128 vy = _mm_add_ps(_mm_mul_ps(_mm_load_ps(e->vy + i), damping), dvy);
+		_mm_store_ps(e->vx + i, vx);
+		_mm_store_ps(e->vy + i, vy);
+		_mm_store_ps(e->px + i, _mm_add_ps(_mm_load_ps(e->px + i), _mm_mul_ps(vx, dt)));
+		_mm_store_ps(e->py + i, _mm_add_ps(_mm_load_ps(e->py + i), _mm_mul_ps(vy, dt)));
+		_mm_store_ps(e->age + i, _mm_add_ps(_mm_load_ps(e->age + i), dt));
+	}
+}
+
+// Interleave one corner of the four particles into four vertices
+static void put4(particle_vertex_t* out, __m128 x, __m128 y, __m128 c, __m128 uv) {
+	__m128 xyLow = _mm_unpacklo_ps(x, y);   // x0 y0 x1 y1
+	__m128 xyHigh = _mm_unpackhi_ps(x, y);  // x2 y2 x3 y3
+	__m128 cuLow = _mm_unpacklo_ps(c, uv);  // c0 uv0 c1 uv1
+	__m128 cuHigh = _mm_unpackhi_ps(c, uv); // c2 uv2 c3 uv3
+	float* v = (float*)out;
+	_mm_storeu_ps(v, _mm_movelh_ps(xyLow, cuLow));
+	_mm_storeu_ps(v + 4, _mm_movehl_ps(cuLow, xyLow));
+	_mm_storeu_ps(v + 8, _mm_movelh_ps(xyHigh, cuHigh));
+	_mm_storeu_ps(v + 12, _mm_movehl_ps(cuHigh, xyHigh));
+}
+
+static void write_groups(emitter_t e, const look_t* l, particle_vertex_t* vertices, int32_t first, int32_t end) {
+	__m128 halfSize = _mm_set1_ps(l->halfSize);
+	__m128 halfSizeDelta = _mm_set1_ps(l->halfSizeDelta);
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 uv0 = _mm_castsi128_ps(_mm_set1_epi32(UV0));
+	__m128 uv1 = _mm_castsi128_ps(_mm_set1_epi32(UV1));
+	__m128 uv2 = _mm_castsi128_ps(_mm_set1_epi32(UV2));
+	__m128 uv3 = _mm_castsi128_ps(_mm_set1_epi32(UV3));
+	__m128 color[4], colorDelta[4];
+	int k;
+	for (k = 0; k < 4; k++) {
+		color[k] = _mm_set1_ps(l->color[k]);
+		colorDelta[k] = _mm_set1_ps(l->colorDelta[k]);
+	}
+
+	int32_t g;
+	for (g = first; g < end; g++) {
+		int32_t i = 4 * g;
+		__m128 x = _mm_load_ps(e->px + i);
+		__m128 y = _mm_load_ps(e->py + i);
+		__m128 t = _mm_mul_ps(_mm_load_ps(e->age + i), _mm_load_ps(e->invLife + i));
+		t = _mm_min_ps(_mm_max_ps(t, zero), one);
+		__m128 h = _mm_add_ps(halfSize, _mm_mul_ps(halfSizeDelta, t));
+
+		__m128i c = _mm_setzero_si128();
+		for (k = 0; k < 4; k++) {
+			__m128 channel = _mm_add_ps(color[k], _mm_mul_ps(colorDelta[k], t));
+			c = _mm_or_si128(c, _mm_slli_epi32(_mm_cvttps_epi32(channel), 8 * k));
+		}
+
+		__m128 left = _mm_sub_ps(x, h), right = _mm_add_ps(x, h);
+		__m128 bottom = _mm_sub_ps(y, h), top = _mm_add_ps(y, h);
+		particle_vertex_t* out = vertices + 16 * g;
+		put4(out, left, bottom, _mm_castsi128_ps(c), uv0);
+		put4(out + 4, right, bottom, _mm_castsi128_ps(c), uv1);
+		put4(out + 8, right, top, _mm_castsi128_ps(c), uv2);
+		put4(out + 12, left, top, _mm_castsi128_ps(c), uv3);
+	}
+}
+
+#else
+
+static uint32_t pack_color(const look_t* l, float t) {
+	uint32_t c = 0;
+	int i;
+	for (i = 0; i < 4; i++)
+		c |= (uint32_t)(l->color[i] + l->colorDelta[i] * t) << (8 * i);
+	return c;
+}
+
+static void update_groups(emitter_t e, const motion_t* m, int32_t first, int32_t end) {
+	int32_t i;
+	for (i = 4 * first; i < 4 * end; i++) {
+		float vx = e->vx[i] * m->damping + m->dvx;
+		float vy = e->vy[i] * m->damping + m->dvy;
+		e->vx[i] = vx;
+		e->vy[i] = vy;
+		e->px[i] += vx * m->dt;
+		e->py[i] += vy * m->dt;
+		e->age[i] += m->dt;
+	}
+}
+
+static void write_groups(emitter_t e, const look_t* l, particle_vertex_t* vertices, int32_t first, int32_t end) {
+	int32_t i;
+	for (i = 4 * first; i < 4 * end; i++) {
+		float t = e->age[i] * e->invLife[i];
+		t = t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+		float h = l->halfSize + l->halfSizeDelta * t;
+		uint32_t c = pack_color(l, t);
+
+		particle_vertex_t* v = vertices + 16 * (i >> 2) + (i & 3);
+		put(v, e->px[i] - h, e->py[i] - h, c, UV0);
+		put(v + 4, e->px[i] + h, e->py[i] - h, c, UV1);
+		put(v + 8, e->px[i] + h, e->py[i] + h, c, UV2);
+		put(v + 12, e->px[i] - h, e->py[i] + h, c, UV3);
+	}
+}
+
+#endif
+
+// --- Workers ---
+
+static void run_part(const job_t* job, int32_t part) {
+	int32_t first = (int32_t)((int64_t)job->groups * part / job->parts);
+	int32_t end = (int32_t)((int64_t)job->groups * (part + 1) / job->parts);
+	if (job->type == JOB_UPDATE)
+		update_groups(job->e, (const motion_t*)job->consts, first, end);
+	else
+		write_groups(job->e, (const look_t*)job->consts, job->vertices, first, end);
+}
+
+static void* work(void* arg) {
+	int32_t part = (int32_t)(intptr_t)arg + 1;
+	uint32_t seen = _startSeq;
+
+	pthread_mutex_lock(&_lock);
+	for (;;) {
+		while (!_quit && _jobSeq == seen)
+			pthread_cond_wait(&_wake, &_lock);
+		if (_quit)
+			break;
+
+		seen = _jobSeq;
+		if (part < _job.parts) {
+			job_t job = _job;
+			pthread_mutex_unlock(&_lock);
+			run_part(&job, part);
+			pthread_mutex_lock(&_lock);
+			if (--_pending == 0)
+				pthread_cond_signal(&_done);
+		}
+	}
+	pthread_mutex_unlock(&_lock);
+	return NULL;
+}
+
+// Split the groups between the calling thread and as many workers as pay off
+static void run(job_type_t type, emitter_t e, const void* consts, particle_vertex_t* vertices, int32_t groups) {
+	job_t job = { type, e, consts, vertices, groups, 1 };
+	int32_t parts = groups / MIN_GROUPS_PER_THREAD;
+	if (parts > _threadCount + 1)
+		parts = _threadCount + 1;
+	if (parts <= 1) {
+		run_part(&job, 0);
+		return;
+	}
+
+	job.parts = parts;
+	pthread_mutex_lock(&_lock);
+	_job = job;
+	_jobSeq++;
+	_pending = parts - 1;
+	pthread_cond_broadcast(&_wake);
+	pthread_mutex_unlock(&_lock);
+
+	run_part(&job, 0);
+
+	pthread_mutex_lock(&_lock);
+	while (_pending > 0)
+		pthread_cond_wait(&_done, &_lock);
+	pthread_mutex_unlock(&_lock);
+}
+
+void gdt_particles_set_threads(int32_t count) {
+	if (count < 0)
+		count = 0;
+	if (count > MAX_THREADS)
+		count = MAX_THREADS;
+
+	int32_t i;
+	if (_threadCount > 0) {
+		pthread_mutex_lock(&_lock);
+		_quit = true;
+		pthread_cond_broadcast(&_wake);
+		pthread_mutex_unlock(&_lock);
+		for (i = 0; i < _threadCount; i++)
+			pthread_join(_threads[i], NULL);
+		_quit = false;
+	}
+
+	_startSeq = _jobSeq;
+	for (_threadCount = 0; _threadCount < count; _threadCount++)
+		if (pthread_create(&_threads[_threadCount], NULL, work, (void*)(intptr_t)_threadCount) != 0)
+			break;
+}
+
+string_t gdt_particles_simd(void) {
+	return SIMD;
+}
+
+// --- Emitters ---
+
+static uint32_t _seed = 2463534242u; // the same effects every run
+
+static float random_float(emitter_t e) {
+	e->random ^= e->random << 13;
+	e->random ^= e->random >> 17;
+	e->random ^= e->random << 5;
+	return (e->random >> 8) * (1.0f / 16777216.0f);
+}
+
+static float between(emitter_t e, float lo, float hi) {
+	return lo + (hi - lo) * random_float(e);
+}
+
+emitter_t gdt_emitter_create(const emitter_params_t* params, int32_t capacity) {
+	emitter_t e = (emitter_t)calloc(1, sizeof(struct emitter));
+	if (e == NULL)
+		return NULL;
+
+	capacity = capacity < 4 ? 4 : (capacity + 3) & ~3;
+	e->block = calloc(6 * (size_t)capacity * sizeof(float) + 15, 1);
+	if (e->block == NULL) {
+		free(e);
+		return NULL;
+	}
+	float* p = (float*)(((uintptr_t)e->block + 15) & ~(uintptr_t)15);
+	e->px = p;
+	e->py = p + capacity;
+	e->vx = p + 2 * capacity;
+	e->vy = p + 3 * capacity;
+	e->age = p + 4 * capacity;
+	e->invLife = p + 5 * capacity;
+
+	e->params = *params;
+	e->capacity = capacity;
+	e->random = _seed;
+	_seed = _seed * 1664525u + 1013904223u;
+	if (e->random == 0)
+		e->random = 1;
+	return e;
+}
+
+void gdt_emitter_destroy(emitter_t e) {
+	free(e->block);
+	free(e);
+}
+
+void gdt_emitter_set_params(emitter_t e, const emitter_params_t* params) {
+	e->params = *params;
+}
+
+void gdt_emitter_move(emitter_t e, float x, float y) {
+	e->x = x;
+	e->y = y;
+}
+
+void gdt_emitter_burst(emitter_t e, int32_t count) {
+	e->burst += count;
+}
+
+int32_t gdt_emitter_count(emitter_t e) {
+	return e->count;
+}
+
+static void spawn(emitter_t e, int32_t count) {
+	const emitter_params_t* p = &e->params;
+	if (count > e->capacity - e->count)
+		count = e->capacity - e->count;
+
+	int32_t i;
+	for (i = e->count; i < e->count + count; i++) {
+		float angle = p->direction + p->spread * (2.0f * random_float(e) - 1.0f);
+		float speed = between(e, p->speed_min, p->speed_max);
+		float life = between(e, p->life_min, p->life_max);
+		e->px[i] = e->x;
+		e->py[i] = e->y;
+		e->vx[i] = cosf(angle) * speed;
+		e->vy[i] = sinf(angle) * speed;
+		e->age[i] = 0.0f;
+		e->invLife[i] = life > 0.001f ? 1.0f / life : 1000.0f;
+	}
+	e->count += count;
+}
+
+void gdt_emitter_update(emitter_t e, float dt) {
+	const emitter_params_t* p = &e->params;
+	motion_t m;
+	m.dt = dt;
+	m.damping = p->drag >= 1.0f ? 0.0f : powf(1.0f - p->drag, dt);
+	m.dvx = p->gravity_x * dt;
+	m.dvy = p->gravity_y * dt;
+	run(JOB_UPDATE, e, &m, NULL, (e->count + 3) / 4);
+
+	// The last one alive takes the place of a dead one
+	int32_t i = 0;
+	while (i < e->count) {
+		if (e->age[i] * e->invLife[i] < 1.0f) {
+			i++;
+			continue;
+		}
+		int32_t last = --e->count;
+		e->px[i] = e->px[last];
+		e->py[i] = e->py[last];
+		e->vx[i] = e->vx[last];
+		e->vy[i] = e->vy[last];
+		e->age[i] = e->age[last];
+		e->invLife[i] = e->invLife[last];
+	}
+
+	e->debt += p->rate * dt;
+	int32_t count = e->burst + (int32_t)e->debt;
+	e->debt -= (int32_t)e->debt;
+	e->burst = 0;
+	spawn(e, count);
+}
+
+int32_t gdt_emitter_write(emitter_t e, particle_vertex_t* vertices) {
+	const emitter_params_t* p = &e->params;
+	int32_t groups = (e->count + 3) / 4;
+	if (groups == 0)
+		return 0;
+
+	look_t l;
+	l.halfSize = 0.5f * p->size_start;
+	l.halfSizeDelta = 0.5f * (p->size_end - p->size_start);
+	int i;
+	for (i = 0; i < 4; i++) {
+		float from = (p->color_start >> (24 - 8 * i)) & 0xff;
+		float to = (p->color_end >> (24 - 8 * i)) & 0xff;
+		l.color[i] = from + 0.5f;
+		l.colorDelta[i] = to - from;
+	}
+	run(JOB_WRITE, e, &l, vertices, groups);
+
+	// The left over particles rounding up to a group are not drawn
+	for (i = e->count; i < 4 * groups; i++) {
+		particle_vertex_t* v = vertices + 16 * (i >> 2) + (i & 3);
+		put(v, 0.0f, 0.0f, 0, UV0);
+		put(v + 4, 0.0f, 0.0f, 0, UV1);
+		put(v + 8, 0.0f, 0.0f, 0, UV2);
+		put(v + 12, 0.0f, 0.0f, 0, UV3);
+	}
+	return 4 * groups;
+}
+
+#ifndef GDT_PARTICLES_HEADLESS
+
+// --- Drawing ---
+
+static string_t TAG = "gdt_particles";
+
+typedef struct {
+	globject_t program;
+	uint32_t generation;
+	GLint scaleUniform;
+	GLint textureUniform;
+} shader_t;
+
+static shader_t _textured;
+static shader_t _round;
+static globject_t _vertexBuffer = NULL;
+static globject_t _indexBuffer = NULL;
+static particle_vertex_t* _scratch = NULL; // without buffer mapping
+static int32_t _scratchCapacity = 0;       // in quads
+static bool _started = false; // the draw objects are kept from then on, effects come and go
+
+static string_t vertexShader =
+	"attribute vec2 position;\n"
+	"attribute vec4 color;\n"
+	"attribute vec2 texcoord;\n"
+	"uniform vec2 scale;\n"
+	"varying vec4 v_color;\n"
+	"varying vec2 v_texcoord;\n"
+	"void main() {\n"
+	"	v_color = color;\n"
+	"	v_texcoord = texcoord;\n"
+	"	gl_Position = vec4(position * scale - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+static string_t texturedShader =
+	"precision mediump float;\n"
+	"uniform sampler2D image;\n"
+	"varying vec4 v_color;\n"
+	"varying vec2 v_texcoord;\n"
+	"void main() {\n"
+	"	gl_FragColor = texture2D(image, v_texcoord) * v_color;\n"
+	"}\n";
+
+// Fades out from the middle to the edge of the quad
+static string_t roundShader =
+	"precision mediump float;\n"
+	"varying vec4 v_color;\n"
+	"varying vec2 v_texcoord;\n"
+	"void main() {\n"
+	"	vec2 d = v_texcoord * 2.0 - 1.0;\n"
+	"	gl_FragColor = v_color * clamp(1.0 - dot(d, d), 0.0, 1.0);\n"
+	"}\n";
+
+static const string_t attributes[] = { "position", "color", "texcoord" };
+
+static bool start(void) {
+	uint16_t* indices = (uint16_t*)malloc(MAX_QUADS * 6 * sizeof(uint16_t));
+	if (indices == NULL)
+		return false;
+
+	// Vertices come a group of four particles at a time, ordered by corner
+	int32_t i;
+	for (i = 0; i < MAX_QUADS; i++) {
+		uint16_t* q = indices + 6 * i;
+		uint16_t v = 16 * (i >> 2) + (i & 3);
+		q[0] = v;
+		q[1] = v + 4;
+		q[2] = v + 8;
+		q[3] = v;
+		q[4] = v + 8;
+		q[5] = v + 12;
+	}
+
+	_textured.program = gdt_gl_program(vertexShader, texturedShader, attributes, 3, 0);
+	_round.program = gdt_gl_program(vertexShader, roundShader, attributes, 3, 0);
+	_textured.generation = _round.generation = 0;
+	_indexBuffer = gdt_gl_buffer(GL_ELEMENT_ARRAY_BUFFER, indices, MAX_QUADS * 6 * sizeof(uint16_t), GL_STATIC_DRAW, 0);
+	_vertexBuffer = gdt_gl_buffer(GL_ARRAY_BUFFER, NULL, 1024 * 4 * sizeof(particle_vertex_t), GL_STREAM_DRAW, 0);
+	free(indices);
+	_started = true;
+	return _textured.program && _round.program && _indexBuffer && _vertexBuffer;
+}
+
+static int32_t write_all(const emitter_t* emitters, int32_t count, particle_vertex_t* vertices) {
+	int32_t quads = 0;
+	int32_t i;
+	for (i = 0; i < count; i++)
+		quads += gdt_emitter_write(emitters[i], vertices + 4 * quads);
+	return quads;
+}
+
+void gdt_particles_draw(const emitter_t* emitters, int32_t count, GLuint texture) {
+	int32_t quads = 0;
+	int32_t i;
+	for (i = 0; i < count; i++)
+		quads += (gdt_emitter_count(emitters[i]) + 3) & ~3;
+	if (quads == 0 || gdt_surface_width() <= 0 || gdt_surface_height() <= 0)
+		return;
+
+	if (!_started && !start()) {
+		gdt_log(LOG_ERROR, TAG, "could not make the GL objects to draw particles with");
+		return;
+	}
+
+	shader_t* s = texture ? &_textured : &_round;
+	GLuint program = s->program ? gdt_gl_name(s->program) : 0;
+	if (program == 0)
+		return;
+
+	int32_t size = quads * 4 * sizeof(particle_vertex_t);
+	particle_vertex_t* mapped = (particle_vertex_t*)gdt_gl_buffer_map(_vertexBuffer, size);
+	if (mapped) {
+		write_all(emitters, count, mapped);
+		if (!gdt_gl_buffer_unmap(_vertexBuffer))
+			return;
+	} else {
+		if (quads > _scratchCapacity) {
+			particle_vertex_t* scratch = (particle_vertex_t*)realloc(_scratch, size);
+			if (scratch == NULL) {
+				gdt_log(LOG_ERROR, TAG, "out of memory, %d particles not drawn", quads);
+				return;
+			}
+			_scratch = scratch;
+			_scratchCapacity = quads;
+		}
+		write_all(emitters, count, _scratch);
+		gdt_gl_buffer_stream(_vertexBuffer, _scratch, size);
+	}
+
+	glUseProgram(program);
+	if (s->generation != gdt_gl_generation(s->program)) {
+		s->generation = gdt_gl_generation(s->program);
+		s->scaleUniform = glGetUniformLocation(program, "scale");
+		s->textureUniform = glGetUniformLocation(program, "image");
+	}
+	glUniform2f(s->scaleUniform, 2.0f / gdt_surface_width(), 2.0f / gdt_surface_height());
+	if (texture) {
+		glUniform1i(s->textureUniform, 0);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, texture);
+	}
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+	glBindBuffer(GL_ARRAY_BUFFER, gdt_gl_name(_vertexBuffer));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gdt_gl_name(_indexBuffer));
+	for (i = 0; i < 3; i++)
+		glEnableVertexAttribArray(i);
+
+	// One draw unless there are more quads than 16 bit indices reach
+	int32_t first;
+	for (first = 0; first < quads; first += MAX_QUADS) {
+		int32_t n = quads - first < MAX_QUADS ? quads - first : MAX_QUADS;
+		uintptr_t base = first * 4 * sizeof(particle_vertex_t);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(particle_vertex_t), (const void*)(base + offsetof(particle_vertex_t, x)));
+		glVertexAttribPointer(1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(particle_vertex_t), (const void*)(base + offsetof(particle_vertex_t, rgba)));
+		glVertexAttribPointer(2, 2, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(particle_vertex_t), (const void*)(base + offsetof(particle_vertex_t, u)));
+		glDrawElements(GL_TRIANGLES, n * 6, GL_UNSIGNED_SHORT, NULL);
+	}
+
+	for (i = 0; i < 3; i++)
+		glDisableVertexAttribArray(i);
+}
+
+#endif // GDT_PARTICLES_HEADLESS
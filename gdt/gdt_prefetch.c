@@ -0,0 +1,471 @@
+/*
+ * gdt_prefetch.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gdt_internal.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static string_t TAG = "gdt_prefetch";
+
+/* Manifest format, one entry per line:
+ *   file <index> <size> <mtime> <path>
+ *   range <file index> <offset> <length>
+ * Ranges are in the order the resources were first loaded. A file whose
+ * size or mtime changed since (e.g. an updated package) is skipped.
+ */
+#define MANIFEST_VERSION "gdt_prefetch 1"
+
+// Read ahead in pieces of this size, so that a replay can stop soon
+#define CHUNK_BYTES (1 << 20)
+
+typedef struct {
+	char* path;
+	int64_t size;
+	int64_t mtime;
+} file_t;
+
+typedef struct {
+	int32_t file;
+	int64_t offset;
+	int64_t length;
+} range_t;
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static char* _phase = NULL; // being recorded, NULL if none
+static uint64_t _launchDeadline = 0;
+
+static file_t* _files = NULL;
+static int32_t _fileCount = 0;
+static int32_t _fileCapacity = 0;
+static range_t* _ranges = NULL;
+static int32_t _rangeCount = 0;
+static int32_t _rangeCapacity = 0;
+
+/* Open addressing hash tables of indices into _files (by path) and
+ * _ranges (by file and offset), -1 for empty slots. Kept at most half
+ * full, so every load noted costs about the same however many came before.
+ */
+static int32_t* _fileSlots = NULL;
+static int32_t _fileSlotCount = 0;
+static int32_t* _rangeSlots = NULL;
+static int32_t _rangeSlotCount = 0;
+
+// A finished recording, written to its manifest by a thread of its own
+typedef struct {
+	char* phase;
+	file_t* files;
+	int32_t fileCount;
+	range_t* ranges;
+	int32_t rangeCount;
+} recording_t;
+
+// Bumped when a phase begins, a replay still going for an earlier one stops
+static uint32_t _generation = 0;
+
+typedef struct {
+	char* path;
+	uint32_t generation;
+} replay_t;
+
+
+static bool grow(void** array, int32_t* capacity, int32_t count, size_t size) {
+	if (count < *capacity)
+		return true;
+
+	int32_t c = *capacity ? 2 * *capacity : 64;
+	void* a = realloc(*array, c * size);
+	if (a == NULL)
+		return false;
+
+	*array = a;
+	*capacity = c;
+	return true;
+}
+
+static char* manifest_path(string_t phase) {
+	string_t dir = gdt_get_cache_directory_path();
+	char* s;
+	if (dir == NULL || asprintf(&s, "%s/gdt_prefetch_%s.txt", dir, phase) == -1)
+		return NULL;
+	return s;
+}
+
+static uint32_t hash_path(string_t s) {
+	uint32_t h = 2166136261u;
+	while (*s)
+		h = (h ^ (uint8_t)*s++) * 16777619u;
+	return h;
+}
+
+static uint32_t hash_range(int32_t file, int64_t offset) {
+	uint64_t k = ((uint64_t)file << 48) ^ (uint64_t)offset;
+	k *= 0x9e3779b97f4a7c15ULL;
+	return (uint32_t)(k >> 32);
+}
+
+static uint32_t hash_of(bool files, int32_t index) {
+	return files ? hash_path(_files[index].path) : hash_range(_ranges[index].file, _ranges[index].offset);
+}
+
+// Make room for count entries, rehashing the ones there are
+static bool reserve(bool files, int32_t count) {
+	int32_t** slots = files ? &_fileSlots : &_rangeSlots;
+	int32_t* slotCount = files ? &_fileSlotCount : &_rangeSlotCount;
+	if (2 * count <= *slotCount)
+		return true;
+
+	int32_t n = *slotCount ? 2 * *slotCount : 256;
+	while (2 * count > n)
+		n *= 2;
+	int32_t* a = (int32_t*)malloc(n * sizeof(int32_t));
+	if (a == NULL)
+		return false;
+	memset(a, 0xff, n * sizeof(int32_t));
+
+	int32_t i;
+	for (i = 0; i < count - 1; i++) {
+		uint32_t h = hash_of(files, i) & (n - 1);
+		while (a[h] != -1)
+			h = (h + 1) & (n - 1);
+		a[h] = i;
+	}
+
+	free(*slots);
+	*slots = a;
+	*slotCount = n;
+	return true;
+}
+
+static int32_t find_file(string_t path) {
+	if (!reserve(true, _fileCount + 1))
+		return -1;
+
+	uint32_t mask = _fileSlotCount - 1;
+	uint32_t h = hash_path(path) & mask;
+	for (; _fileSlots[h] != -1; h = (h + 1) & mask)
+		if (strcmp(_files[_fileSlots[h]].path, path) == 0)
+			return _fileSlots[h];
+
+	struct stat info;
+	if (stat(path, &info) == -1)
+		return -1;
+
+	if (!grow((void**)&_files, &_fileCapacity, _fileCount, sizeof(file_t)))
+		return -1;
+
+	file_t* f = &_files[_fileCount];
+	f->path = strdup(path);
+	if (f->path == NULL)
+		return -1;
+	f->size = info.st_size;
+	f->mtime = info.st_mtime;
+	_fileSlots[h] = _fileCount;
+	return _fileCount++;
+}
+
+// Only the first load of a range matters, it is resident after that
+static void add_range(int32_t file, int64_t offset, int64_t length) {
+	if (!reserve(false, _rangeCount + 1))
+		return;
+
+	uint32_t mask = _rangeSlotCount - 1;
+	uint32_t h = hash_range(file, offset) & mask;
+	for (; _rangeSlots[h] != -1; h = (h + 1) & mask) {
+		range_t* r = &_ranges[_rangeSlots[h]];
+		if (r->file == file && r->offset == offset)
+			return;
+	}
+
+	if (!grow((void**)&_ranges, &_rangeCapacity, _rangeCount, sizeof(range_t)))
+		return;
+
+	_ranges[_rangeCount].file = file;
+	_ranges[_rangeCount].offset = offset;
+	_ranges[_rangeCount].length = length;
+	_rangeSlots[h] = _rangeCount++;
+}
+
+static void write_manifest(const recording_t* r) {
+	char* path = manifest_path(r->phase);
+	char* tmp = NULL;
+	if (path == NULL || asprintf(&tmp, "%s.tmp", path) == -1) {
+		free(path);
+		return;
+	}
+
+	FILE* f = fopen(tmp, "w");
+	if (f) {
+		int32_t i;
+		int64_t total = 0;
+
+		fprintf(f, "%s\n", MANIFEST_VERSION);
+		for (i = 0; i < r->fileCount; i++)
+			fprintf(f, "file %d %lld %lld %s\n", i,
+			        (long long)r->files[i].size, (long long)r->files[i].mtime, r->files[i].path);
+		for (i = 0; i < r->rangeCount; i++) {
+			fprintf(f, "range %d %lld %lld\n", r->ranges[i].file,
+			        (long long)r->ranges[i].offset, (long long)r->ranges[i].length);
+			total += r->ranges[i].length;
+		}
+
+		if (fclose(f) == 0 && rename(tmp, path) == 0)
+			gdt_log(LOG_DEBUG, TAG, "recorded %d ranges, %lld kB, for phase %s",
+			        r->rangeCount, (long long)(total >> 10), r->phase);
+	}
+
+	free(tmp);
+	free(path);
+}
+
+static void free_recording(recording_t* r) {
+	int32_t i;
+	for (i = 0; i < r->fileCount; i++)
+		free(r->files[i].path);
+	free(r->files);
+	free(r->ranges);
+	free(r->phase);
+	free(r);
+}
+
+static void* write_recording(void* arg) {
+	gdt_platform_thread_begin();
+	write_manifest((recording_t*)arg);
+	free_recording((recording_t*)arg);
+	gdt_platform_thread_end();
+	return NULL;
+}
+
+// The recording is handed over to a thread that writes it, this is called within frames
+static void stop_recording(void) {
+	if (_phase == NULL)
+		return;
+
+	recording_t* r = (recording_t*)malloc(sizeof(recording_t));
+	if (r) {
+		r->phase = _phase;
+		r->files = _files;
+		r->fileCount = _fileCount;
+		r->ranges = _ranges;
+		r->rangeCount = _rangeCount;
+		_files = NULL;
+		_ranges = NULL;
+		_fileCapacity = _rangeCapacity = 0;
+	} else {
+		int32_t i;
+		for (i = 0; i < _fileCount; i++)
+			free(_files[i].path);
+		free(_phase);
+	}
+	_fileCount = 0;
+	_rangeCount = 0;
+	if (_fileSlots)
+		memset(_fileSlots, 0xff, _fileSlotCount * sizeof(int32_t));
+	if (_rangeSlots)
+		memset(_rangeSlots, 0xff, _rangeSlotCount * sizeof(int32_t));
+
+	__atomic_store_n(&_phase, NULL, __ATOMIC_RELAXED);
+	__atomic_store_n(&_launchDeadline, 0, __ATOMIC_RELAXED);
+
+	// An empty recording (e.g. hidden right away) would only replace a useful one
+	if (r == NULL || r->rangeCount == 0) {
+		if (r)
+			free_recording(r);
+		return;
+	}
+
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, write_recording, r) != 0) {
+		write_manifest(r);
+		free_recording(r);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+
+
+static void advise(int fd, int64_t offset, int64_t length) {
+#if defined(__APPLE__)
+	struct radvisory ra;
+	ra.ra_offset = offset;
+	ra.ra_count = (int)length;
+	fcntl(fd, F_RDADVISE, &ra);
+#elif defined(__linux__)
+	readahead(fd, offset, length);
+#else
+	posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED);
+#endif
+}
+
+static bool cancelled(replay_t* r) {
+	return __atomic_load_n(&_generation, __ATOMIC_RELAXED) != r->generation;
+}
+
+static void read_ahead(replay_t* r) {
+	FILE* f = fopen(r->path, "r");
+
+	int* fds = NULL;
+	int32_t fdCount = 0;
+	int32_t fdCapacity = 0;
+	int64_t total = 0;
+	char line[1024 + 64];
+
+	if (f && fgets(line, sizeof(line), f) && strncmp(line, MANIFEST_VERSION, strlen(MANIFEST_VERSION)) == 0) {
+		while (!cancelled(r) && fgets(line, sizeof(line), f)) {
+			int32_t index;
+			long long a, b;
+			int pathStart;
+
+			if (sscanf(line, "file %d %lld %lld %n", &index, &a, &b, &pathStart) == 3) {
+				if (index != fdCount || !grow((void**)&fds, &fdCapacity, fdCount, sizeof(int)))
+					break;
+
+				line[strcspn(line, "\n")] = '\0';
+				int fd = open(line + pathStart, O_RDONLY);
+
+				struct stat info;
+				if (fd != -1 && (fstat(fd, &info) == -1 || info.st_size != a || info.st_mtime != b)) {
+					close(fd);
+					fd = -1;
+				}
+				fds[fdCount++] = fd;
+			} else if (sscanf(line, "range %d %lld %lld", &index, &a, &b) == 3) {
+				if (index < 0 || index >= fdCount || fds[index] == -1)
+					continue;
+
+				for (; b > 0 && !cancelled(r); a += CHUNK_BYTES, b -= CHUNK_BYTES) {
+					advise(fds[index], a, b < CHUNK_BYTES ? b : CHUNK_BYTES);
+					total += b < CHUNK_BYTES ? b : CHUNK_BYTES;
+				}
+			}
+		}
+	}
+
+	if (f) {
+		fclose(f);
+		gdt_log(LOG_DEBUG, TAG, "read ahead %lld kB from %s", (long long)(total >> 10), r->path);
+	}
+
+	int32_t i;
+	for (i = 0; i < fdCount; i++)
+		if (fds[i] != -1)
+			close(fds[i]);
+	free(fds);
+	free(r->path);
+	free(r);
+}
+
+static void* replay(void* arg) {
+	gdt_platform_thread_begin();
+	read_ahead((replay_t*)arg);
+	gdt_platform_thread_end();
+	return NULL;
+}
+
+static void start_replay(string_t phase) {
+	replay_t* r = (replay_t*)malloc(sizeof(replay_t));
+	if (r == NULL)
+		return;
+
+	r->path = manifest_path(phase);
+	r->generation = __atomic_add_fetch(&_generation, 1, __ATOMIC_RELAXED);
+
+	struct stat info;
+	if (r->path == NULL || stat(r->path, &info) == -1) {
+		free(r->path);
+		free(r);
+		return;
+	}
+
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attr, replay, r) != 0) {
+		gdt_log(LOG_WARNING, TAG, "could not start reading ahead for phase %s", phase);
+		free(r->path);
+		free(r);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+
+
+void gdt_prefetch_phase_begin(string_t phase) {
+	pthread_mutex_lock(&_lock);
+
+	stop_recording();
+	start_replay(phase);
+	__atomic_store_n(&_phase, strdup(phase), __ATOMIC_RELAXED);
+
+	pthread_mutex_unlock(&_lock);
+}
+
+void gdt_prefetch_phase_end(void) {
+	pthread_mutex_lock(&_lock);
+	stop_recording();
+	pthread_mutex_unlock(&_lock);
+}
+
+void gdt_prefetch_launch(void) {
+	gdt_prefetch_phase_begin("launch");
+
+	pthread_mutex_lock(&_lock);
+	__atomic_store_n(&_launchDeadline, gdt_time_ns() + GDT_PREFETCH_LAUNCH_NS, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&_lock);
+}
+
+bool gdt_prefetch_recording(void) {
+	return __atomic_load_n(&_phase, __ATOMIC_RELAXED) != NULL;
+}
+
+void gdt_prefetch_note(string_t file, int64_t offset, int64_t length) {
+	pthread_mutex_lock(&_lock);
+
+	int32_t i = _phase ? find_file(file) : -1;
+	if (i != -1)
+		add_range(i, offset, length);
+
+	pthread_mutex_unlock(&_lock);
+}
+
+void gdt_prefetch_poll(uint64_t now) {
+	// Only locked once, when the launch phase is over
+	uint64_t deadline = __atomic_load_n(&_launchDeadline, __ATOMIC_RELAXED);
+	if (deadline == 0 || now < deadline)
+		return;
+
+	pthread_mutex_lock(&_lock);
+	if (_launchDeadline && now >= _launchDeadline)
+		stop_recording();
+	pthread_mutex_unlock(&_lock);
+}
@@ -0,0 +1,463 @@
+/*
+ * gdt_resource_dir.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gdt_internal.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#define USE_INOTIFY
+#endif
+
+static string_t TAG = "gdt_resource_dir";
+
+static char* _dir = NULL;
+static resourcechangedhandler_t cb_resource_changed = NULL;
+
+// Paths changed since the last poll, deduplicated
+static char** _changed = NULL;
+static int _changedCount = 0;
+static int _changedCapacity = 0;
+
+
+static char* join(string_t a, string_t b) {
+	char* s;
+	if (asprintf(&s, "%s%s", a, b) == -1)
+		return NULL;
+	return s;
+}
+
+static void mark_changed(string_t resourcePath) {
+	int i;
+	for (i = 0; i < _changedCount; i++)
+		if (strcmp(_changed[i], resourcePath) == 0)
+			return;
+
+	if (_changedCount == _changedCapacity) {
+		int capacity = _changedCapacity ? 2 * _changedCapacity : 16;
+		char** changed = realloc(_changed, capacity * sizeof(char*));
+		if (changed == NULL)
+			return;
+		_changed = changed;
+		_changedCapacity = capacity;
+	}
+
+	_changed[_changedCount] = strdup(resourcePath);
+	if (_changed[_changedCount])
+		_changedCount++;
+}
+
+static void dispatch_changed(void) {
+	int i;
+	for (i = 0; i < _changedCount; i++) {
+		if (cb_resource_changed)
+			cb_resource_changed(_changed[i]);
+		free(_changed[i]);
+	}
+	_changedCount = 0;
+}
+
+
+
+#ifdef USE_INOTIFY
+
+/* One inotify watch per directory, since inotify is not recursive.
+ * path is relative to _dir in resource form, "" for the root and
+ * "/gfx" for a subdirectory.
+ */
+typedef struct {
+	int wd;
+	char* path;
+} watch_t;
+
+static int _inotify = -1;
+static watch_t* _watches = NULL;
+static int _watchCount = 0;
+static int _watchCapacity = 0;
+
+static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                   IN_CREATE | IN_DELETE | IN_DELETE_SELF;
+
+static watch_t* find_watch(int wd) {
+	int i;
+	for (i = 0; i < _watchCount; i++)
+		if (_watches[i].wd == wd)
+			return &_watches[i];
+	return NULL;
+}
+
+static void add_watch(string_t path) {
+	char* full = join(_dir, path);
+	if (full == NULL)
+		return;
+
+	int wd = inotify_add_watch(_inotify, full, WATCH_MASK);
+	if (wd == -1) {
+		gdt_log(LOG_WARNING, TAG, "could not watch %s (%s)", full, strerror(errno));
+		free(full);
+		return;
+	}
+
+	watch_t* w = find_watch(wd);
+	if (w == NULL) {
+		if (_watchCount == _watchCapacity) {
+			int capacity = _watchCapacity ? 2 * _watchCapacity : 16;
+			watch_t* watches = realloc(_watches, capacity * sizeof(watch_t));
+			if (watches == NULL) {
+				free(full);
+				return;
+			}
+			_watches = watches;
+			_watchCapacity = capacity;
+		}
+		w = &_watches[_watchCount++];
+	} else {
+		free(w->path);
+	}
+	w->wd = wd;
+	w->path = strdup(path);
+
+	DIR* d = opendir(full);
+	free(full);
+	if (d == NULL)
+		return;
+
+	struct dirent* e;
+	while ((e = readdir(d)) != NULL) {
+		if (e->d_name[0] == '.')
+			continue;
+
+		char* sub;
+		if (asprintf(&sub, "%s/%s", path, e->d_name) == -1)
+			continue;
+
+		char* subFull = join(_dir, sub);
+		struct stat info;
+		if (subFull && stat(subFull, &info) == 0 && S_ISDIR(info.st_mode))
+			add_watch(sub);
+
+		free(subFull);
+		free(sub);
+	}
+	closedir(d);
+}
+
+// The directory is gone (or unmounted), a new one by the same name gets a new watch
+static void drop_watch(watch_t* w) {
+	free(w->path);
+	*w = _watches[--_watchCount];
+}
+
+static void remove_watches(void) {
+	int i;
+	for (i = 0; i < _watchCount; i++)
+		free(_watches[i].path);
+	_watchCount = 0;
+
+	if (_inotify != -1) {
+		close(_inotify);
+		_inotify = -1;
+	}
+}
+
+static bool start_watching(void) {
+	_inotify = inotify_init();
+	if (_inotify == -1)
+		return false;
+
+	fcntl(_inotify, F_SETFL, fcntl(_inotify, F_GETFL) | O_NONBLOCK);
+	add_watch("");
+	return true;
+}
+
+static void note_resource_mapped(string_t resourcePath) {
+	// inotify reports every change in the tree, nothing to track
+}
+
+static void collect_changes(void) {
+	char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	if (_inotify == -1)
+		return;
+
+	for (;;) {
+		ssize_t len = read(_inotify, buf, sizeof(buf));
+		if (len <= 0)
+			break;
+
+		char* p = buf;
+		while (p < buf + len) {
+			struct inotify_event* ev = (struct inotify_event*)p;
+			p += sizeof(struct inotify_event) + ev->len;
+
+			if (ev->mask & IN_Q_OVERFLOW) {
+				// Events were dropped, we can no longer tell what changed
+				mark_changed("/");
+				continue;
+			}
+
+			watch_t* w = find_watch(ev->wd);
+			if (w != NULL && (ev->mask & IN_IGNORED)) {
+				drop_watch(w);
+				continue;
+			}
+			if (w == NULL || ev->len == 0)
+				continue;
+
+			char* path;
+			if (asprintf(&path, "%s/%s", w->path, ev->name) == -1)
+				continue;
+
+			if (ev->mask & IN_ISDIR) {
+				if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+					add_watch(path);
+			} else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE)) {
+				// IN_CREATE is left out, the write that follows it is reported as IN_CLOSE_WRITE
+				mark_changed(path);
+			}
+			free(path);
+		}
+	}
+}
+
+#else
+
+/* Without inotify the files that have been mapped are stat:ed instead.
+ * Only a few of them are checked each frame so that a large set of
+ * resources never costs more than a handful of syscalls per frame.
+ * Resources are mapped on whatever thread loads them (the background init
+ * worker, the simulation thread) while the poll runs on the GL thread, so
+ * the list is only touched with _trackedLock held.
+ */
+#define CHECKS_PER_FRAME 8
+
+typedef struct {
+	char* path;
+	time_t mtime;
+	off_t size;
+} tracked_t;
+
+static tracked_t* _tracked = NULL;
+static int _trackedCount = 0;
+static int _trackedCapacity = 0;
+static int _nextCheck = 0;
+static pthread_mutex_t _trackedLock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool stat_resource(string_t resourcePath, time_t* mtime, off_t* size) {
+	char* full = join(_dir, resourcePath);
+	if (full == NULL)
+		return false;
+
+	struct stat info;
+	int r = stat(full, &info);
+	free(full);
+
+	if (r == -1)
+		return false;
+
+	*mtime = info.st_mtime;
+	*size = info.st_size;
+	return true;
+}
+
+static void remove_watches(void) {
+	int i;
+	pthread_mutex_lock(&_trackedLock);
+	for (i = 0; i < _trackedCount; i++)
+		free(_tracked[i].path);
+	_trackedCount = 0;
+	_nextCheck = 0;
+	pthread_mutex_unlock(&_trackedLock);
+}
+
+static bool start_watching(void) {
+	return true;
+}
+
+static void note_resource_mapped(string_t resourcePath) {
+	int i;
+	time_t mtime;
+	off_t size;
+
+	// Stat:ed before taking the lock, the poll should not wait on the disk
+	if (!stat_resource(resourcePath, &mtime, &size))
+		return;
+
+	pthread_mutex_lock(&_trackedLock);
+	for (i = 0; i < _trackedCount; i++)
+		if (strcmp(_tracked[i].path, resourcePath) == 0)
+			goto done;
+
+	if (_trackedCount == _trackedCapacity) {
+		int capacity = _trackedCapacity ? 2 * _trackedCapacity : 16;
+		tracked_t* tracked = realloc(_tracked, capacity * sizeof(tracked_t));
+		if (tracked == NULL)
+			goto done;
+		_tracked = tracked;
+		_trackedCapacity = capacity;
+	}
+
+	tracked_t* t = &_tracked[_trackedCount];
+	t->path = strdup(resourcePath);
+	t->mtime = mtime;
+	t->size = size;
+	if (t->path)
+		_trackedCount++;
+
+done:
+	pthread_mutex_unlock(&_trackedLock);
+}
+
+static void collect_changes(void) {
+	int n;
+	pthread_mutex_lock(&_trackedLock);
+	for (n = 0; n < CHECKS_PER_FRAME && n < _trackedCount; n++) {
+		if (_nextCheck >= _trackedCount)
+			_nextCheck = 0;
+
+		tracked_t* t = &_tracked[_nextCheck++];
+		time_t mtime = 0;
+		off_t size = -1;
+		stat_resource(t->path, &mtime, &size);
+
+		if (mtime != t->mtime || size != t->size) {
+			t->mtime = mtime;
+			t->size = size;
+			mark_changed(t->path);
+		}
+	}
+	pthread_mutex_unlock(&_trackedLock);
+}
+
+#endif
+
+
+
+void gdt_set_callback_resource_changed(resourcechangedhandler_t on_resource_changed) {
+	cb_resource_changed = on_resource_changed;
+}
+
+bool gdt_resource_set_directory(string_t directoryPath) {
+	remove_watches();
+	free(_dir);
+	_dir = NULL;
+
+	if (directoryPath == NULL)
+		return true;
+
+	struct stat info;
+	if (stat(directoryPath, &info) == -1 || !S_ISDIR(info.st_mode)) {
+		gdt_log(LOG_WARNING, TAG, "not a directory: %s", directoryPath);
+		return false;
+	}
+
+	_dir = strdup(directoryPath);
+	if (_dir == NULL)
+		return false;
+
+	// Trailing slashes would otherwise double up with the leading one of resource paths
+	size_t len = strlen(_dir);
+	while (len > 1 && _dir[len - 1] == '/')
+		_dir[--len] = '\0';
+
+	if (!start_watching())
+		gdt_log(LOG_WARNING, TAG, "could not watch %s, changes will not be reported", _dir);
+
+	gdt_log(LOG_NORMAL, TAG, "serving resources from %s", _dir);
+	return true;
+}
+
+void* gdt_resource_dir_map(string_t resourcePath, int32_t* length) {
+	if (_dir == NULL || resourcePath == NULL || resourcePath[0] != '/')
+		return NULL;
+
+	char* full = join(_dir, resourcePath);
+	if (full == NULL)
+		return NULL;
+
+	int fd = open(full, O_RDONLY);
+	if (fd == -1) {
+		free(full);
+		return NULL;
+	}
+
+	/* The file is read into anonymous memory rather than mapped. A mapping
+	 * of a file the dev tool truncates or rewrites in place would raise
+	 * SIGBUS on the next read, before the change is even reported.
+	 */
+	struct stat info;
+	void* bytes = MAP_FAILED;
+	size_t got = 0;
+	if (fstat(fd, &info) == 0 && info.st_size > 0)
+		bytes = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	while (bytes != MAP_FAILED && got < (size_t)info.st_size) {
+		ssize_t n = read(fd, (char*)bytes + got, info.st_size - got);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break; // shrunk meanwhile, the change is reported on the next poll
+		got += n;
+	}
+	close(fd);
+
+	if (bytes != MAP_FAILED && got < (size_t)info.st_size) {
+		// Callers munmap() the length returned, so the pages past it go now
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t keep = (got + page - 1) / page * page;
+		if (keep < (size_t)info.st_size)
+			munmap((char*)bytes + keep, info.st_size - keep);
+		if (got == 0)
+			bytes = MAP_FAILED;
+	}
+
+	if (bytes != MAP_FAILED && gdt_prefetch_recording())
+		gdt_prefetch_note(full, 0, got);
+	free(full);
+
+	if (bytes == MAP_FAILED)
+		return NULL;
+
+	mprotect(bytes, got, PROT_READ);
+	note_resource_mapped(resourcePath);
+
+	*length = got;
+	return bytes;
+}
+
+void gdt_resource_dir_poll(void) {
+	if (_dir == NULL)
+		return;
+
+	collect_changes();
+	dispatch_changed();
+}
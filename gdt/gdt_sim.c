@@ -0,0 +1,347 @@
+/*
+ * gdt_sim.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gdt_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+static string_t TAG = "gdt_sim";
+
+typedef enum {
+	EVENT_TOUCH,
+	EVENT_TEXT,
+	EVENT_ACCELEROMETER,
+	EVENT_HOOK
+} event_type_t;
+
+typedef struct {
+	event_type_t type;
+	union {
+		struct {
+			touchhandler_t cb;
+			touch_type_t what;
+			int x;
+			int y;
+		} touch;
+		struct {
+			texthandler_t cb;
+			char* text; // owned copy, unless it is gdt_backspace()
+		} text;
+		struct {
+			accelerometerhandler_t cb;
+			accelerometer_data_t data;
+		} accelerometer;
+		struct {
+			sim_hook_t hook;
+			uint64_t ticket; // non-zero if the poster waits for it
+		} hook;
+	} u;
+} event_t;
+
+static pthread_t _thread;
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t _done = PTHREAD_COND_INITIALIZER;
+static bool _running = false;
+static bool _visible = true;
+
+// Growable ring of pending events, guarded by _lock
+static event_t* _events = NULL;
+static int _eventHead = 0;
+static int _eventCount = 0;
+static int _eventCapacity = 0;
+static uint64_t _ticketsPosted = 0;
+static uint64_t _ticketsDone = 0;
+
+static simhandler_t _step = NULL;
+static uint64_t _stepNs = 0;
+
+/* Triple buffer. The writer (simulation thread) owns _back, the reader
+ * (render thread) owns _front, and _middle holds the index of the third
+ * slot, plus FRESH if it was published since the reader last took it.
+ * Both sides only ever swap their slot with the middle one, atomically,
+ * so neither of them waits for the other.
+ */
+#define SLOT_MASK 3
+#define FRESH 4
+
+static uint8_t* _slots[3];
+static uint32_t _back = 0;
+static uint32_t _front = 1;
+static uint32_t _middle = 2;
+static bool _hasFront = false;
+
+
+static void publish(void) {
+	uint32_t old = __atomic_exchange_n(&_middle, _back | FRESH, __ATOMIC_ACQ_REL);
+	_back = old & SLOT_MASK;
+}
+
+const void* gdt_sim_snapshot(void) {
+	if (!_running)
+		return NULL;
+
+	if (__atomic_load_n(&_middle, __ATOMIC_ACQUIRE) & FRESH) {
+		uint32_t old = __atomic_exchange_n(&_middle, _front, __ATOMIC_ACQ_REL);
+		_front = old & SLOT_MASK;
+		_hasFront = true;
+	}
+
+	return _hasFront ? _slots[_front] : NULL;
+}
+
+
+
+static bool push(const event_t* e) {
+	if (_eventCount == _eventCapacity) {
+		int capacity = _eventCapacity ? 2 * _eventCapacity : 64;
+		event_t* events = (event_t*)malloc(capacity * sizeof(event_t));
+		if (events == NULL)
+			return false;
+
+		int i;
+		for (i = 0; i < _eventCount; i++)
+			events[i] = _events[(_eventHead + i) % _eventCapacity];
+
+		free(_events);
+		_events = events;
+		_eventHead = 0;
+		_eventCapacity = capacity;
+	}
+
+	_events[(_eventHead + _eventCount) % _eventCapacity] = *e;
+	_eventCount++;
+	pthread_cond_signal(&_wake);
+	return true;
+}
+
+static bool post(event_t* e) {
+	pthread_mutex_lock(&_lock);
+
+	bool posted = _running && push(e);
+
+	pthread_mutex_unlock(&_lock);
+	return posted;
+}
+
+static void dispatch(event_t* e) {
+	switch (e->type) {
+		case EVENT_TOUCH:
+			e->u.touch.cb(e->u.touch.what, e->u.touch.x, e->u.touch.y);
+			break;
+		case EVENT_TEXT:
+			e->u.text.cb(e->u.text.text);
+			if (e->u.text.text != gdt_backspace())
+				free(e->u.text.text);
+			break;
+		case EVENT_ACCELEROMETER:
+			e->u.accelerometer.cb(&e->u.accelerometer.data);
+			break;
+		case EVENT_HOOK:
+			switch (e->u.hook.hook) {
+				case SIM_HOOK_ACTIVE:
+					gdt_hook_active();
+					break;
+				case SIM_HOOK_INACTIVE:
+					gdt_hook_inactive();
+					break;
+				case SIM_HOOK_SAVE_STATE:
+					gdt_hook_save_state();
+					break;
+			}
+			break;
+	}
+}
+
+static void deadline_after(struct timespec* ts, uint64_t ns) {
+	// Condition variables wait on the wall clock, gdt_time_ns() might not be it
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	uint64_t t = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_usec * 1000ULL + ns;
+	ts->tv_sec = t / 1000000000ULL;
+	ts->tv_nsec = t % 1000000000ULL;
+}
+
+static void* run(void* _) {
+	gdt_platform_thread_begin();
+
+	uint64_t next = gdt_time_ns();
+
+	pthread_mutex_lock(&_lock);
+	while (_running) {
+		if (_eventCount > 0) {
+			event_t e = _events[_eventHead];
+			_eventHead = (_eventHead + 1) % _eventCapacity;
+			_eventCount--;
+
+			pthread_mutex_unlock(&_lock);
+			dispatch(&e);
+			pthread_mutex_lock(&_lock);
+
+			if (e.type == EVENT_HOOK && e.u.hook.ticket) {
+				_ticketsDone = e.u.hook.ticket;
+				pthread_cond_broadcast(&_done);
+			}
+			continue;
+		}
+
+		if (!_visible) {
+			pthread_cond_wait(&_wake, &_lock);
+			next = gdt_time_ns();
+			continue;
+		}
+
+		uint64_t now = gdt_time_ns();
+		if (now < next) {
+			struct timespec ts;
+			deadline_after(&ts, next - now);
+			pthread_cond_timedwait(&_wake, &_lock, &ts);
+			continue;
+		}
+
+		pthread_mutex_unlock(&_lock);
+		_step(_stepNs, _slots[_back]);
+		publish();
+		pthread_mutex_lock(&_lock);
+
+		// After a long stall, drop the missed steps instead of running them back to back
+		next += _stepNs;
+		if (now > next + 4 * _stepNs)
+			next = now;
+	}
+	pthread_mutex_unlock(&_lock);
+
+	gdt_platform_thread_end();
+	return NULL;
+}
+
+
+
+static void free_slots(void) {
+	int i;
+	for (i = 0; i < 3; i++) {
+		free(_slots[i]);
+		_slots[i] = NULL;
+	}
+}
+
+bool gdt_sim_start(int32_t snapshotSize, uint64_t stepNs, simhandler_t on_step) {
+	if (_running || snapshotSize <= 0 || stepNs == 0 || on_step == NULL)
+		return false;
+
+	int i;
+	for (i = 0; i < 3; i++) {
+		_slots[i] = (uint8_t*)calloc(1, snapshotSize);
+		if (_slots[i] == NULL) {
+			free_slots();
+			return false;
+		}
+	}
+
+	_step = on_step;
+	_stepNs = stepNs;
+	_running = true;
+
+	if (pthread_create(&_thread, NULL, run, NULL) != 0) {
+		gdt_log(LOG_ERROR, TAG, "could not start the simulation thread");
+		_running = false;
+		free_slots();
+		return false;
+	}
+
+	return true;
+}
+
+bool gdt_sim_running(void) {
+	return _running;
+}
+
+bool gdt_sim_post_touch(touchhandler_t cb, touch_type_t what, int x, int y) {
+	event_t e;
+	e.type = EVENT_TOUCH;
+	e.u.touch.cb = cb;
+	e.u.touch.what = what;
+	e.u.touch.x = x;
+	e.u.touch.y = y;
+	return post(&e);
+}
+
+bool gdt_sim_post_text(texthandler_t cb, string_t text) {
+	if (!_running)
+		return false;
+
+	event_t e;
+	e.type = EVENT_TEXT;
+	e.u.text.cb = cb;
+	e.u.text.text = text == gdt_backspace() ? (char*)text : strdup(text);
+
+	if (post(&e))
+		return true;
+
+	if (e.u.text.text != gdt_backspace())
+		free(e.u.text.text);
+	return false;
+}
+
+bool gdt_sim_post_accelerometer(accelerometerhandler_t cb, accelerometer_data_t* data) {
+	event_t e;
+	e.type = EVENT_ACCELEROMETER;
+	e.u.accelerometer.cb = cb;
+	e.u.accelerometer.data = *data;
+	return post(&e);
+}
+
+bool gdt_sim_post_hook(sim_hook_t hook) {
+	event_t e;
+	e.type = EVENT_HOOK;
+	e.u.hook.hook = hook;
+	e.u.hook.ticket = 0;
+
+	pthread_mutex_lock(&_lock);
+
+	bool posted = false;
+	if (_running) {
+		// The game may be killed right after gdt_hook_save_state(), so wait for it
+		if (hook == SIM_HOOK_SAVE_STATE)
+			e.u.hook.ticket = ++_ticketsPosted;
+
+		posted = push(&e);
+
+		while (posted && e.u.hook.ticket && _ticketsDone < e.u.hook.ticket)
+			pthread_cond_wait(&_done, &_lock);
+	}
+
+	pthread_mutex_unlock(&_lock);
+	return posted;
+}
+
+void gdt_sim_set_visible(bool visible) {
+	pthread_mutex_lock(&_lock);
+	_visible = visible;
+	pthread_cond_signal(&_wake);
+	pthread_mutex_unlock(&_lock);
+}
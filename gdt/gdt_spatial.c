@@ -0,0 +1,396 @@
+/*
+ * gdt_spatial.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <gdt/gdt_spatial.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_BUCKETS 1024 // power of two
+#define LEVELS 4             // grids, each 8 times coarser than the one before
+#define LEVEL_SHIFT 3
+#define MAX_CELLS 16         // an object covering more cells goes to a coarser grid
+#define MAX_CELL 0x3fffffff  // far enough out in any direction
+
+typedef struct {
+	float x0, y0, x1, y1;
+} rect_t;
+
+typedef struct {
+	rect_t r;
+	int32_t cx0, cy0, cx1, cy1; // cells covered in its level
+	int32_t level;              // -1 if too large for any, kept aside
+	int32_t z;
+	uint32_t seq;               // insertion order, for ties in z
+	uint32_t stamp;             // last query it was found in, to report it once
+	bool used;
+	void* data;
+} object_t;
+
+typedef struct {
+	int32_t* ids;
+	int32_t count;
+	int32_t capacity;
+} bucket_t;
+
+struct spatial {
+	float inverseCellSize[LEVELS];
+
+	object_t* objects;
+	int32_t objectCapacity;  // used or not
+	int32_t count;
+	int32_t* free;           // unused IDs
+	int32_t freeCount;
+	uint32_t seq;
+	uint32_t stamp;
+
+	bucket_t* buckets;       // of all levels
+	uint32_t mask;           // bucket count - 1
+	int32_t entries;         // in all buckets
+	bucket_t aside;
+};
+
+
+// --- Cells ---
+
+static int32_t cell(spatial_t s, int32_t level, float v) {
+	float c = floorf(v * s->inverseCellSize[level]);
+	return c < -MAX_CELL ? -MAX_CELL : c > MAX_CELL ? MAX_CELL : (int32_t)c;
+}
+
+static bucket_t* bucket(spatial_t s, int32_t level, int32_t cx, int32_t cy) {
+	return &s->buckets[((uint32_t)cx * 73856093u ^ (uint32_t)cy * 19349663u ^ (uint32_t)level * 83492791u) & s->mask];
+}
+
+static bool bucket_add(bucket_t* b, int32_t id) {
+	if (b->count == b->capacity) {
+		int32_t capacity = b->capacity ? 2 * b->capacity : 4;
+		int32_t* ids = (int32_t*)realloc(b->ids, capacity * sizeof(int32_t));
+		if (ids == NULL)
+			return false;
+		b->ids = ids;
+		b->capacity = capacity;
+	}
+	b->ids[b->count++] = id;
+	return true;
+}
+
+static void bucket_remove(bucket_t* b, int32_t id) {
+	int32_t i;
+	for (i = 0; i < b->count; i++) {
+		if (b->ids[i] == id) {
+			b->ids[i] = b->ids[--b->count];
+			return;
+		}
+	}
+}
+
+static int32_t cells_of(const object_t* o) {
+	return (o->cx1 - o->cx0 + 1) * (o->cy1 - o->cy0 + 1);
+}
+
+static void unlist(spatial_t s, int32_t id) {
+	object_t* o = &s->objects[id];
+	if (o->level < 0) {
+		bucket_remove(&s->aside, id);
+		return;
+	}
+
+	int32_t cx, cy;
+	for (cy = o->cy0; cy <= o->cy1; cy++)
+		for (cx = o->cx0; cx <= o->cx1; cx++)
+			bucket_remove(bucket(s, o->level, cx, cy), id);
+	s->entries -= cells_of(o);
+}
+
+// Add id to the cells in its range, or aside. Returns false, listed nowhere, if out of memory.
+static bool list(spatial_t s, int32_t id) {
+	object_t* o = &s->objects[id];
+	if (o->level < 0)
+		return bucket_add(&s->aside, id);
+
+	int32_t cx, cy;
+	for (cy = o->cy0; cy <= o->cy1; cy++) {
+		for (cx = o->cx0; cx <= o->cx1; cx++) {
+			if (!bucket_add(bucket(s, o->level, cx, cy), id)) {
+				// Undo the cells done so far, in the rows before and in this one
+				int32_t ux, uy;
+				for (uy = o->cy0; uy <= cy; uy++)
+					for (ux = o->cx0; ux <= (uy == cy ? cx - 1 : o->cx1); ux++)
+						bucket_remove(bucket(s, o->level, ux, uy), id);
+				return false;
+			}
+		}
+	}
+	s->entries += cells_of(o);
+	return true;
+}
+
+// Twice the buckets once they hold two entries each on average
+static void grow(spatial_t s) {
+	if ((uint32_t)s->entries <= 2 * (s->mask + 1) || s->mask >= 0x3fffffff)
+		return;
+
+	uint32_t count = 2 * (s->mask + 1);
+	bucket_t* buckets = (bucket_t*)calloc(count, sizeof(bucket_t));
+	if (buckets == NULL)
+		return;
+
+	bucket_t* old = s->buckets;
+	uint32_t oldCount = s->mask + 1;
+	int32_t oldEntries = s->entries;
+	s->buckets = buckets;
+	s->mask = count - 1;
+	s->entries = 0;
+
+	int32_t id;
+	uint32_t i;
+	for (id = 0; id < s->objectCapacity; id++) {
+		if (s->objects[id].used && s->objects[id].level >= 0 && !list(s, id)) {
+			// Out of memory half way, stay with the old buckets
+			for (i = 0; i < count; i++)
+				free(buckets[i].ids);
+			free(buckets);
+			s->buckets = old;
+			s->mask = oldCount - 1;
+			s->entries = oldEntries;
+			return;
+		}
+	}
+
+	for (i = 0; i < oldCount; i++)
+		free(old[i].ids);
+	free(old);
+}
+
+static void set_bounds(spatial_t s, object_t* o, float x, float y, float width, float height) {
+	o->r.x0 = x;
+	o->r.y0 = y;
+	o->r.x1 = x + width;
+	o->r.y1 = y + height;
+
+	// The finest grid where it covers few cells
+	for (o->level = 0; o->level < LEVELS; o->level++) {
+		o->cx0 = cell(s, o->level, o->r.x0);
+		o->cy0 = cell(s, o->level, o->r.y0);
+		o->cx1 = cell(s, o->level, o->r.x1);
+		o->cy1 = cell(s, o->level, o->r.y1);
+		if ((int64_t)(o->cx1 - o->cx0 + 1) * (o->cy1 - o->cy0 + 1) <= MAX_CELLS)
+			return;
+	}
+	o->level = -1;
+}
+
+static bool above(const object_t* a, const object_t* b) {
+	return a->z != b->z ? a->z > b->z : a->seq > b->seq;
+}
+
+static uint32_t next_stamp(spatial_t s) {
+	if (++s->stamp == 0) {
+		int32_t id;
+		for (id = 0; id < s->objectCapacity; id++)
+			s->objects[id].stamp = 0;
+		s->stamp = 1;
+	}
+	return s->stamp;
+}
+
+static bool contains(const rect_t* r, float x, float y) {
+	return x >= r->x0 && x < r->x1 && y >= r->y0 && y < r->y1;
+}
+
+static bool overlaps(const rect_t* a, const rect_t* b) {
+	return a->x0 < b->x1 && b->x0 < a->x1 && a->y0 < b->y1 && b->y0 < a->y1;
+}
+
+static int32_t pick_in(spatial_t s, const bucket_t* b, float x, float y, int32_t best) {
+	int32_t i;
+	for (i = 0; i < b->count; i++) {
+		const object_t* o = &s->objects[b->ids[i]];
+		if (contains(&o->r, x, y) && (best < 0 || above(o, &s->objects[best])))
+			best = b->ids[i];
+	}
+	return best;
+}
+
+// Add the objects of b overlapping r that were not found before in this query
+static void query_in(spatial_t s, const bucket_t* b, const rect_t* r, uint32_t stamp,
+                     int32_t* ids, int32_t max, int32_t* n) {
+	int32_t i;
+	for (i = 0; i < b->count; i++) {
+		object_t* o = &s->objects[b->ids[i]];
+		if (o->stamp != stamp && overlaps(&o->r, r)) {
+			o->stamp = stamp;
+			if (*n < max)
+				ids[*n] = b->ids[i];
+			(*n)++;
+		}
+	}
+}
+
+
+
+spatial_t gdt_spatial_create(float cellSize) {
+	spatial_t s = (spatial_t)calloc(1, sizeof(struct spatial));
+	if (s == NULL)
+		return NULL;
+
+	int32_t level;
+	for (level = 0; level < LEVELS; level++)
+		s->inverseCellSize[level] = 1 / (cellSize * (1 << (LEVEL_SHIFT * level)));
+
+	s->buckets = (bucket_t*)calloc(INITIAL_BUCKETS, sizeof(bucket_t));
+	if (s->buckets == NULL) {
+		free(s);
+		return NULL;
+	}
+	s->mask = INITIAL_BUCKETS - 1;
+	return s;
+}
+
+void gdt_spatial_destroy(spatial_t s) {
+	uint32_t i;
+	for (i = 0; i <= s->mask; i++)
+		free(s->buckets[i].ids);
+	free(s->buckets);
+	free(s->aside.ids);
+	free(s->objects);
+	free(s->free);
+	free(s);
+}
+
+int32_t gdt_spatial_insert(spatial_t s, float x, float y, float width, float height, int32_t z, void* data) {
+	if (s->freeCount == 0) {
+		int32_t capacity = s->objectCapacity ? 2 * s->objectCapacity : 64;
+		object_t* objects = (object_t*)realloc(s->objects, capacity * sizeof(object_t));
+		if (objects == NULL)
+			return -1;
+		s->objects = objects;
+		int32_t* ids = (int32_t*)realloc(s->free, capacity * sizeof(int32_t));
+		if (ids == NULL)
+			return -1;
+		s->free = ids;
+
+		// Lowest IDs used first
+		int32_t id;
+		for (id = capacity - 1; id >= s->objectCapacity; id--) {
+			s->objects[id].used = false;
+			s->free[s->freeCount++] = id;
+		}
+		s->objectCapacity = capacity;
+	}
+
+	int32_t id = s->free[s->freeCount - 1];
+	object_t* o = &s->objects[id];
+	set_bounds(s, o, x, y, width, height);
+	o->z = z;
+	o->seq = s->seq++;
+	o->stamp = 0;
+	o->data = data;
+	if (!list(s, id))
+		return -1;
+
+	o->used = true;
+	s->freeCount--;
+	s->count++;
+	grow(s);
+	return id;
+}
+
+void gdt_spatial_move(spatial_t s, int32_t id, float x, float y, float width, float height) {
+	object_t* o = &s->objects[id];
+	object_t moved = *o;
+	set_bounds(s, &moved, x, y, width, height);
+
+	// Still in the same cells, only its rectangle changes
+	if (moved.level == o->level && moved.cx0 == o->cx0 && moved.cy0 == o->cy0 &&
+	    moved.cx1 == o->cx1 && moved.cy1 == o->cy1) {
+		*o = moved;
+		return;
+	}
+
+	unlist(s, id);
+	object_t old = *o;
+	*o = moved;
+	if (!list(s, id)) {
+		// Out of memory, keep it where it was
+		*o = old;
+		list(s, id);
+		return;
+	}
+	grow(s);
+}
+
+void gdt_spatial_remove(spatial_t s, int32_t id) {
+	unlist(s, id);
+	s->objects[id].used = false;
+	s->free[s->freeCount++] = id;
+	s->count--;
+}
+
+void* gdt_spatial_data(spatial_t s, int32_t id) {
+	return s->objects[id].data;
+}
+
+int32_t gdt_spatial_pick(spatial_t s, float x, float y) {
+	int32_t best = -1;
+	int32_t level;
+	for (level = 0; level < LEVELS; level++)
+		best = pick_in(s, bucket(s, level, cell(s, level, x), cell(s, level, y)), x, y, best);
+	return pick_in(s, &s->aside, x, y, best);
+}
+
+int32_t gdt_spatial_query(spatial_t s, float x, float y, float width, float height, int32_t* ids, int32_t max) {
+	rect_t r = { x, y, x + width, y + height };
+	uint32_t stamp = next_stamp(s);
+	int32_t n = 0;
+	int32_t i, level, cx, cy;
+
+	// Looking at every object is cheaper than looking at that many cells
+	int64_t cells = (int64_t)(cell(s, 0, r.x1) - cell(s, 0, r.x0) + 1) * (cell(s, 0, r.y1) - cell(s, 0, r.y0) + 1);
+	if (cells > s->count) {
+		for (i = 0; i < s->objectCapacity; i++) {
+			if (s->objects[i].used && overlaps(&s->objects[i].r, &r)) {
+				if (n < max)
+					ids[n] = i;
+				n++;
+			}
+		}
+		return n;
+	}
+
+	for (level = 0; level < LEVELS; level++) {
+		int32_t cx0 = cell(s, level, r.x0), cy0 = cell(s, level, r.y0);
+		int32_t cx1 = cell(s, level, r.x1), cy1 = cell(s, level, r.y1);
+		for (cy = cy0; cy <= cy1; cy++)
+			for (cx = cx0; cx <= cx1; cx++)
+				query_in(s, bucket(s, level, cx, cy), &r, stamp, ids, max, &n);
+	}
+	query_in(s, &s->aside, &r, stamp, ids, max, &n);
+	return n;
+}
+
+int32_t gdt_spatial_count(spatial_t s) {
+	return s->count;
+}
@@ -0,0 +1,246 @@
+/*
+ * gdt_startup.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gdt_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+static string_t TAG = "gdt_startup";
+
+// Deferred work run on the render thread gets this much of every frame
+#define DEFER_BUDGET_NS 2000000
+
+typedef struct deferred {
+	deferhandler_t fn;
+	struct deferred* next;
+} deferred_t;
+
+typedef struct {
+	deferred_t* head;
+	deferred_t* tail;
+} queue_t;
+
+static startup_phase_t _phases[GDT_STARTUP_MAX_PHASES];
+static int32_t _phaseCount = 0;
+static uint64_t _origin = 0;
+
+static bool _rendered = false;
+static bool _presented = false; // read from any thread, by gdt_defer_init_background()
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static queue_t _renderQueue;
+static queue_t _backgroundQueue;
+static bool _workerRunning = false;
+
+
+static void enqueue(queue_t* q, deferhandler_t fn) {
+	deferred_t* d = (deferred_t*)malloc(sizeof(deferred_t));
+	if (d == NULL) {
+		fn(); // better late than never
+		return;
+	}
+	d->fn = fn;
+	d->next = NULL;
+
+	pthread_mutex_lock(&_lock);
+	if (q->tail)
+		q->tail->next = d;
+	else
+		q->head = d;
+	q->tail = d;
+	pthread_mutex_unlock(&_lock);
+}
+
+static deferhandler_t dequeue(queue_t* q) {
+	pthread_mutex_lock(&_lock);
+
+	deferred_t* d = q->head;
+	if (d) {
+		q->head = d->next;
+		if (q->head == NULL)
+			q->tail = NULL;
+	}
+
+	pthread_mutex_unlock(&_lock);
+
+	if (d == NULL)
+		return NULL;
+
+	deferhandler_t fn = d->fn;
+	free(d);
+	return fn;
+}
+
+static void* run_background(void* _) {
+	gdt_platform_thread_begin();
+
+	for (;;) {
+		deferhandler_t fn = dequeue(&_backgroundQueue);
+		if (fn == NULL) {
+			// Checked again under the lock so nothing queued meanwhile is left behind
+			pthread_mutex_lock(&_lock);
+			bool done = _backgroundQueue.head == NULL;
+			if (done)
+				_workerRunning = false;
+			pthread_mutex_unlock(&_lock);
+
+			if (done)
+				break;
+			continue;
+		}
+		fn();
+	}
+
+	gdt_platform_thread_end();
+	return NULL;
+}
+
+static void start_worker(void) {
+	pthread_mutex_lock(&_lock);
+	bool start = !_workerRunning && _backgroundQueue.head != NULL;
+	if (start)
+		_workerRunning = true;
+	pthread_mutex_unlock(&_lock);
+
+	if (!start)
+		return;
+
+	pthread_t thread;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	if (pthread_create(&thread, &attr, run_background, NULL) != 0) {
+		gdt_log(LOG_WARNING, TAG, "could not start a worker, running deferred work on the render thread");
+		deferhandler_t fn;
+		while ((fn = dequeue(&_backgroundQueue)) != NULL)
+			enqueue(&_renderQueue, fn);
+
+		pthread_mutex_lock(&_lock);
+		_workerRunning = false;
+		pthread_mutex_unlock(&_lock);
+	}
+	pthread_attr_destroy(&attr);
+}
+
+static void log_phases(void) {
+	startup_phase_t phases[GDT_STARTUP_MAX_PHASES];
+	int32_t count = gdt_startup_phases(phases, GDT_STARTUP_MAX_PHASES);
+	int32_t i;
+	uint64_t previous = 0;
+
+	for (i = 0; i < count; i++) {
+		gdt_log(LOG_NORMAL, TAG, "%8.1f ms (+%7.1f ms) %s",
+		        phases[i].time_ns / 1e6, (phases[i].time_ns - previous) / 1e6, phases[i].name);
+		previous = phases[i].time_ns;
+	}
+}
+
+
+
+void gdt_startup_mark_at(string_t phase, uint64_t time) {
+	pthread_mutex_lock(&_lock);
+	if (_phaseCount == GDT_STARTUP_MAX_PHASES) {
+		pthread_mutex_unlock(&_lock);
+		return;
+	}
+
+	if (_phaseCount == 0)
+		_origin = time;
+
+	// Phases marked after the fact (like process start) can be earlier than the origin
+	if (time < _origin) {
+		int32_t i;
+		for (i = 0; i < _phaseCount; i++)
+			_phases[i].time_ns += _origin - time;
+		_origin = time;
+	}
+
+	int32_t at = _phaseCount;
+	while (at > 0 && _phases[at - 1].time_ns > time - _origin) {
+		_phases[at] = _phases[at - 1];
+		at--;
+	}
+
+	_phases[at].name = phase;
+	_phases[at].time_ns = time - _origin;
+	_phaseCount++;
+	pthread_mutex_unlock(&_lock);
+}
+
+void gdt_startup_mark(string_t phase) {
+	gdt_startup_mark_at(phase, gdt_time_ns());
+}
+
+int32_t gdt_startup_phases(startup_phase_t* phases, int32_t max) {
+	int32_t i;
+	pthread_mutex_lock(&_lock);
+	for (i = 0; i < _phaseCount && i < max; i++)
+		phases[i] = _phases[i];
+	pthread_mutex_unlock(&_lock);
+	return i;
+}
+
+void gdt_defer_init(deferhandler_t fn) {
+	enqueue(&_renderQueue, fn);
+}
+
+void gdt_defer_init_background(deferhandler_t fn) {
+	enqueue(&_backgroundQueue, fn);
+
+	if (__atomic_load_n(&_presented, __ATOMIC_ACQUIRE))
+		start_worker();
+}
+
+
+
+void gdt_startup_frame_rendered(void) {
+	if (!_rendered) {
+		_rendered = true;
+		gdt_startup_mark("first frame rendered");
+	}
+}
+
+void gdt_startup_frame_presented(void) {
+	if (!_rendered || _presented)
+		return;
+
+	gdt_startup_mark("first frame presented");
+	__atomic_store_n(&_presented, true, __ATOMIC_RELEASE);
+	log_phases();
+	start_worker();
+}
+
+void gdt_startup_run_deferred(uint64_t start) {
+	if (!_presented)
+		return;
+
+	// At least one per frame, more while within the budget
+	deferhandler_t fn;
+	while ((fn = dequeue(&_renderQueue)) != NULL) {
+		fn();
+		if (gdt_time_ns() - start >= DEFER_BUDGET_NS)
+			break;
+	}
+}
@@ -0,0 +1,440 @@
+/*
+ * gdt_texture.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gdt_internal.h"
+#include <gdt/gdt_texture.h>
+#include <stdlib.h>
+#include <string.h>
+
+static string_t TAG = "gdt_texture";
+
+#define DEFAULT_BUDGET_BYTES (32 << 20)
+#define UPDATE_BUDGET_NS 2000000
+#define MINIMUM_SIZE 32 // levels this large and smaller are always resident
+
+struct texture {
+	resource_t resource;
+	const texture_header_t* header;
+	const uint8_t* bytes;
+	GLenum wrap;
+	globject_t object;
+	int32_t index;     // in _textures
+
+	int32_t resident;  // most detailed level on the GPU
+	int32_t minimum;   // least detailed level it ever goes down to
+	int64_t residentBytes;
+
+	// From gdt_texture_need(), as of frame needed
+	uint64_t needed;
+	int32_t wanted;
+	int32_t priority;
+};
+
+static texture_t* _textures = NULL;
+static int32_t _textureCount = 0;
+static int32_t _textureCapacity = 0;
+
+// Scratch for gdt_texture_update(), as large as _textures
+static texture_t* _pending = NULL;
+static texture_t* _victims = NULL;
+static int32_t _scratchCapacity = 0;
+
+/* The frame being rendered, counted up by gdt_texture_update() once it has
+ * seen what was needed in it. Starts at 1, a texture needed in 0 never was.
+ */
+static uint64_t _frame = 1;
+
+static int64_t _budget = DEFAULT_BUDGET_BYTES;
+static int64_t _residentBytes = 0;
+static uint64_t _uploads = 0;
+static uint64_t _uploadBytes = 0;
+static uint64_t _evictions = 0;
+
+
+// --- Levels ---
+
+static int32_t bytes_per_pixel(uint32_t format, uint32_t type) {
+	if (type == GL_UNSIGNED_BYTE) {
+		switch (format) {
+			case GL_RGBA:
+				return 4;
+			case GL_RGB:
+				return 3;
+			case GL_LUMINANCE:
+				return 1;
+		}
+	} else if ((type == GL_UNSIGNED_SHORT_5_6_5 && format == GL_RGB) ||
+	           (type == GL_UNSIGNED_SHORT_4_4_4_4 && format == GL_RGBA)) {
+		return 2;
+	}
+	return 0;
+}
+
+static uint32_t level_width(const texture_header_t* h, int32_t level) {
+	uint32_t w = h->width >> level;
+	return w ? w : 1;
+}
+
+static uint32_t level_height(const texture_header_t* h, int32_t level) {
+	uint32_t w = h->height >> level;
+	return w ? w : 1;
+}
+
+// Bytes on the GPU with level and all smaller levels resident
+static int64_t bytes_from(texture_t t, int32_t level) {
+	int64_t n = 0;
+	int32_t i;
+	for (i = level; i < (int32_t)t->header->level_count; i++)
+		n += t->header->levels[i].size;
+	return n;
+}
+
+/* Specify the bound texture with levels resident and smaller, resident
+ * becoming GL level 0. Any larger GL levels from before are left over but
+ * not used, the texture is complete at its new size.
+ */
+static void specify(texture_t t) {
+	const texture_header_t* h = t->header;
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	int32_t i;
+	for (i = t->resident; i < (int32_t)h->level_count; i++)
+		glTexImage2D(GL_TEXTURE_2D, i - t->resident, h->format, level_width(h, i), level_height(h, i), 0,
+		             h->format, h->type, t->bytes + h->levels[i].offset);
+
+	_residentBytes += bytes_from(t, t->resident) - t->residentBytes;
+	t->residentBytes = bytes_from(t, t->resident);
+	_uploads++;
+	_uploadBytes += t->residentBytes;
+}
+
+// Recipe for the registry, also run when restoring after a context loss
+static GLuint make(void* data) {
+	texture_t t = (texture_t)data;
+
+	GLuint name;
+	glGenTextures(1, &name);
+	glBindTexture(GL_TEXTURE_2D, name);
+	specify(t);
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, t->wrap);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, t->wrap);
+	return name;
+}
+
+// Move to level, now if the texture is on the GPU or else when it is made again
+static void set_resident(texture_t t, int32_t level) {
+	t->resident = level;
+	if (gdt_gl_ready(t->object)) {
+		gdt_gl_bindings_changing();
+		glBindTexture(GL_TEXTURE_2D, gdt_gl_name(t->object));
+		specify(t);
+	} else {
+		_residentBytes += bytes_from(t, level) - t->residentBytes;
+		t->residentBytes = bytes_from(t, level);
+	}
+}
+
+
+
+// --- Streaming ---
+
+static bool needed_last_frame(texture_t t) {
+	return t->needed == _frame;
+}
+
+// The level t can give up detail down to without being missed
+static int32_t evict_level(texture_t t) {
+	return needed_last_frame(t) ? t->wanted : t->minimum;
+}
+
+// Longest unneeded first, then lowest priority
+static int by_staleness(const void* a, const void* b) {
+	texture_t x = *(const texture_t*)a;
+	texture_t y = *(const texture_t*)b;
+	if (x->needed != y->needed)
+		return x->needed < y->needed ? -1 : 1;
+	if (x->priority != y->priority)
+		return x->priority < y->priority ? -1 : 1;
+	return x->index - y->index;
+}
+
+// Highest priority first, then furthest from what it needs
+static int by_urgency(const void* a, const void* b) {
+	texture_t x = *(const texture_t*)a;
+	texture_t y = *(const texture_t*)b;
+	if (x->priority != y->priority)
+		return x->priority > y->priority ? -1 : 1;
+	int32_t gx = x->resident - x->wanted;
+	int32_t gy = y->resident - y->wanted;
+	if (gx != gy)
+		return gx > gy ? -1 : 1;
+	return x->index - y->index;
+}
+
+static bool reserve_scratch(void) {
+	if (_scratchCapacity >= _textureCount)
+		return true;
+
+	texture_t* pending = (texture_t*)realloc(_pending, _textureCount * sizeof(texture_t));
+	if (pending == NULL)
+		return false;
+	_pending = pending;
+
+	texture_t* victims = (texture_t*)realloc(_victims, _textureCount * sizeof(texture_t));
+	if (victims == NULL)
+		return false;
+	_victims = victims;
+
+	_scratchCapacity = _textureCount;
+	return true;
+}
+
+/* Evict until another bytes fit in the budget, or there is nothing left
+ * to evict. Returns whether they fit.
+ */
+static bool make_room(int64_t bytes) {
+	if (_residentBytes + bytes <= _budget)
+		return true;
+
+	int32_t i, n = 0;
+	for (i = 0; i < _textureCount; i++)
+		if (_textures[i]->resident < evict_level(_textures[i]))
+			_victims[n++] = _textures[i];
+	qsort(_victims, n, sizeof(texture_t), by_staleness);
+
+	for (i = 0; i < n && _residentBytes + bytes > _budget; i++) {
+		set_resident(_victims[i], evict_level(_victims[i]));
+		_evictions++;
+	}
+	return _residentBytes + bytes <= _budget;
+}
+
+void gdt_texture_update(uint64_t start) {
+	if (_textureCount == 0 || !reserve_scratch()) {
+		_frame++;
+		return;
+	}
+
+	// The game's texture binding and unpack alignment are put back after
+	gdt_gl_keep_bindings_begin();
+
+	// The budget may have shrunk, or detail may no longer be needed
+	make_room(0);
+
+	int32_t i, n = 0;
+	for (i = 0; i < _textureCount; i++)
+		if (needed_last_frame(_textures[i]) && _textures[i]->wanted < _textures[i]->resident)
+			_pending[n++] = _textures[i];
+
+	/* One level at a time round the pending textures, so the most urgent
+	 * ones do not hold up all the others while they come in. Pending
+	 * textures are never victims, they have less detail than they need.
+	 */
+	bool first = true;
+	while (n > 0) {
+		qsort(_pending, n, sizeof(texture_t), by_urgency);
+
+		int32_t kept = 0;
+		for (i = 0; i < n; i++) {
+			texture_t t = _pending[i];
+			if (!first && gdt_time_ns() - start >= UPDATE_BUDGET_NS)
+				goto done;
+			if (!make_room(t->header->levels[t->resident - 1].size))
+				goto done;
+
+			set_resident(t, t->resident - 1);
+			first = false;
+			if (t->wanted < t->resident)
+				_pending[kept++] = t;
+		}
+		n = kept;
+	}
+
+done:
+	gdt_gl_keep_bindings_end();
+	_frame++;
+}
+
+
+
+static bool npot_supported(void) {
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	return extensions && strstr(extensions, "GL_OES_texture_npot");
+}
+
+texture_t gdt_texture_open(string_t resourcePath, GLenum wrap) {
+	resource_t resource = gdt_resource_load(resourcePath);
+	if (resource == NULL) {
+		gdt_log(LOG_WARNING, TAG, "could not load %s", resourcePath);
+		return NULL;
+	}
+
+	const uint8_t* bytes = (const uint8_t*)gdt_resource_bytes(resource);
+	uint32_t length = gdt_resource_length(resource);
+	const texture_header_t* h = (const texture_header_t*)bytes;
+
+	if (length < sizeof(texture_header_t) || h->magic != GDT_TEXTURE_MAGIC) {
+		gdt_log(LOG_WARNING, TAG, "%s is not a texture", resourcePath);
+		goto fail;
+	}
+	if (h->version != GDT_TEXTURE_VERSION) {
+		gdt_log(LOG_WARNING, TAG, "%s has unsupported texture version %u", resourcePath, h->version);
+		goto fail;
+	}
+
+	// The whole chain down to 1x1, every level where it claims to be
+	int32_t bpp = bytes_per_pixel(h->format, h->type);
+	uint32_t levels = 1;
+	while ((h->width > h->height ? h->width : h->height) >> levels)
+		levels++;
+	if (bpp == 0 || h->width == 0 || h->height == 0 || h->level_count != levels ||
+	    levels > GDT_TEXTURE_MAX_LEVELS) {
+		gdt_log(LOG_WARNING, TAG, "%s is not a supported texture", resourcePath);
+		goto fail;
+	}
+
+	// Core GLES2 can not mipmap or repeat other sizes, they would sample black
+	bool pot = (h->width & (h->width - 1)) == 0 && (h->height & (h->height - 1)) == 0;
+	if (!pot && !npot_supported()) {
+		gdt_log(LOG_WARNING, TAG, "%s is %ux%u, not a power of two, and OES_texture_npot is missing",
+		        resourcePath, h->width, h->height);
+		goto fail;
+	}
+
+	int32_t i;
+	for (i = 0; i < (int32_t)levels; i++) {
+		const texture_level_t* l = &h->levels[i];
+		if (l->size != (uint64_t)level_width(h, i) * level_height(h, i) * bpp ||
+		    (uint64_t)l->offset + l->size > length) {
+			gdt_log(LOG_WARNING, TAG, "%s is a corrupt texture", resourcePath);
+			goto fail;
+		}
+	}
+
+	if (_textureCount == _textureCapacity) {
+		int32_t capacity = _textureCapacity ? 2 * _textureCapacity : 32;
+		texture_t* textures = (texture_t*)realloc(_textures, capacity * sizeof(texture_t));
+		if (textures == NULL)
+			goto fail;
+		_textures = textures;
+		_textureCapacity = capacity;
+	}
+
+	texture_t t = (texture_t)calloc(1, sizeof(struct texture));
+	if (t == NULL)
+		goto fail;
+
+	t->resource = resource;
+	t->header = h;
+	t->bytes = bytes;
+	t->wrap = wrap;
+
+	t->minimum = levels - 1;
+	while (t->minimum > 0 && level_width(h, t->minimum - 1) <= MINIMUM_SIZE &&
+	       level_height(h, t->minimum - 1) <= MINIMUM_SIZE)
+		t->minimum--;
+	t->resident = t->minimum;
+	t->wanted = t->minimum;
+
+	t->object = gdt_gl_custom(GLOBJECT_TEXTURE, make, t, 0);
+	if (t->object == NULL) {
+		_residentBytes -= t->residentBytes;
+		free(t);
+		goto fail;
+	}
+
+	t->index = _textureCount;
+	_textures[_textureCount++] = t;
+	return t;
+
+fail:
+	gdt_resource_unload(resource);
+	return NULL;
+}
+
+void gdt_texture_close(texture_t t) {
+	gdt_gl_delete(t->object);
+	_residentBytes -= t->residentBytes;
+	gdt_resource_unload(t->resource);
+
+	_textures[t->index] = _textures[--_textureCount];
+	_textures[t->index]->index = t->index;
+	free(t);
+}
+
+GLuint gdt_texture_name(texture_t t) {
+	return gdt_gl_name(t->object);
+}
+
+void gdt_texture_need(texture_t t, float screenSize, int32_t priority) {
+	uint32_t size = t->header->width > t->header->height ? t->header->width : t->header->height;
+
+	// The level that is no smaller than screenSize, for one texel per pixel or more
+	int32_t level = 0;
+	while (level < t->minimum && (float)(size >> (level + 1)) >= screenSize)
+		level++;
+
+	if (t->needed != _frame) {
+		t->needed = _frame;
+		t->wanted = level;
+		t->priority = priority;
+	} else {
+		if (level < t->wanted)
+			t->wanted = level;
+		if (priority > t->priority)
+			t->priority = priority;
+	}
+}
+
+int32_t gdt_texture_level(texture_t t) {
+	return t->resident;
+}
+
+void gdt_texture_set_budget(int64_t bytes) {
+	_budget = bytes;
+}
+
+void gdt_texture_stats(texture_stats_t* stats) {
+	stats->textures = _textureCount;
+	stats->pending = 0;
+	stats->resident_bytes = _residentBytes;
+	stats->wanted_bytes = 0;
+	stats->budget_bytes = _budget;
+	stats->uploads = _uploads;
+	stats->upload_bytes = _uploadBytes;
+	stats->evictions = _evictions;
+
+	// Needed in the frame being rendered or the one before
+	int32_t i;
+	for (i = 0; i < _textureCount; i++) {
+		texture_t t = _textures[i];
+		bool needed = t->needed != 0 && t->needed + 1 >= _frame;
+		if (needed && t->wanted < t->resident)
+			stats->pending++;
+		stats->wanted_bytes += bytes_from(t, needed ? t->wanted : t->minimum);
+	}
+}
@@ -0,0 +1,421 @@
+/*
+ * gdt_timer.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gdt_internal.h"
+#include <gdt/gdt_timer.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The wheel has LEVELS levels of SLOTS slots each. Level 0 holds the timers
+ * due within SLOTS ticks, one slot per tick, level 1 those due within
+ * SLOTS^2 ticks, SLOTS ticks per slot, and so on. Whenever level 0 wraps
+ * around, the next slot of level 1 is spread out over level 0, and so on
+ * upwards, so every timer is moved at most LEVELS - 1 times.
+ * That reaches 2^30 ticks, about 12 days, later timers are clamped to it.
+ */
+#define TICK_NS 1000000ULL
+#define SLOT_BITS 6
+#define SLOTS (1 << SLOT_BITS)
+#define LEVELS 5
+#define MAX_TICKS ((1ULL << (SLOT_BITS * LEVELS)) - 1)
+
+// One more list after the wheel, for the timers being fired
+#define PENDING (LEVELS * SLOTS)
+
+#define NONE -1
+
+typedef struct {
+	uint64_t expires; // tick
+	uint64_t period;  // ticks, 0 if it does not repeat
+	timerhandler_t cb;
+	void* data;
+	uint32_t generation;
+	int32_t list; // NONE when free
+	int32_t prev;
+	int32_t next;
+} node_t;
+
+typedef struct {
+	cohandler_t fn;
+	coroutine_t co;
+	uint32_t generation;
+	bool active;
+	int32_t nextFree;
+	timer_id_t timer; // while sleeping
+} task_t;
+
+// Game clock
+static uint64_t _now = 0;
+static uint64_t _last = 0; // gdt_time_ns() at the last frame, 0 after a pause
+
+static int32_t _lists[LEVELS * SLOTS + 1];
+static bool _listsReady = false;
+static uint64_t _tick = 0; // the next tick to run
+
+static node_t* _nodes = NULL;
+static int32_t _nodeCapacity = 0;
+static int32_t _freeNode = NONE;
+
+static task_t* _tasks = NULL;
+static int32_t _taskCapacity = 0;
+static int32_t _freeTask = NONE;
+
+// Coroutines to resume in the next frame, and the ones for this frame
+static coroutine_id_t* _runnable = NULL;
+static int32_t _runnableCount = 0;
+static int32_t _runnableCapacity = 0;
+static coroutine_id_t* _running = NULL;
+static int32_t _runningCapacity = 0;
+
+
+static uint64_t make_id(uint32_t generation, int32_t index) {
+	return (uint64_t)generation << 32 | (uint32_t)(index + 1);
+}
+
+static int32_t id_index(uint64_t id) {
+	return (int32_t)(uint32_t)id - 1;
+}
+
+static uint32_t id_generation(uint64_t id) {
+	return (uint32_t)(id >> 32);
+}
+
+static bool grow(void** array, int32_t* capacity, int32_t needed, size_t size) {
+	if (needed <= *capacity)
+		return true;
+
+	int32_t c = *capacity ? 2 * *capacity : 64;
+	void* a = realloc(*array, c * size);
+	if (a == NULL)
+		return false;
+
+	*array = a;
+	*capacity = c;
+	return true;
+}
+
+
+
+// --- Timer wheel ---
+
+static void link(int32_t i, int32_t list) {
+	node_t* n = &_nodes[i];
+	n->list = list;
+	n->prev = NONE;
+	n->next = _lists[list];
+	if (n->next != NONE)
+		_nodes[n->next].prev = i;
+	_lists[list] = i;
+}
+
+static void unlink(int32_t i) {
+	node_t* n = &_nodes[i];
+	if (n->prev != NONE)
+		_nodes[n->prev].next = n->next;
+	else
+		_lists[n->list] = n->next;
+	if (n->next != NONE)
+		_nodes[n->next].prev = n->prev;
+}
+
+static void add(int32_t i) {
+	node_t* n = &_nodes[i];
+	if (n->expires < _tick)
+		n->expires = _tick;
+	if (n->expires - _tick > MAX_TICKS)
+		n->expires = _tick + MAX_TICKS;
+
+	uint64_t delta = n->expires - _tick;
+	int level = 0;
+	while (delta >= 1ULL << (SLOT_BITS * (level + 1)))
+		level++;
+
+	link(i, level * SLOTS + (int32_t)((n->expires >> (SLOT_BITS * level)) & (SLOTS - 1)));
+}
+
+static int32_t alloc_node(void) {
+	if (!_listsReady) {
+		int32_t l;
+		for (l = 0; l <= PENDING; l++)
+			_lists[l] = NONE;
+		_listsReady = true;
+
+		// The wheel starts now, not at the first frame, there is nothing to step through before
+		_tick = _now / TICK_NS;
+	}
+
+	if (_freeNode == NONE) {
+		int32_t old = _nodeCapacity;
+		if (!grow((void**)&_nodes, &_nodeCapacity, old + 1, sizeof(node_t)))
+			return NONE;
+
+		int32_t i;
+		for (i = _nodeCapacity - 1; i >= old; i--) {
+			_nodes[i].generation = 1;
+			_nodes[i].list = NONE;
+			_nodes[i].next = _freeNode;
+			_freeNode = i;
+		}
+	}
+
+	int32_t i = _freeNode;
+	_freeNode = _nodes[i].next;
+	return i;
+}
+
+static void free_node(int32_t i) {
+	_nodes[i].generation++;
+	_nodes[i].list = NONE;
+	_nodes[i].next = _freeNode;
+	_freeNode = i;
+}
+
+static timer_id_t start_timer(uint64_t ns, uint64_t period, timerhandler_t cb, void* data) {
+	int32_t i = alloc_node();
+	if (i == NONE)
+		return 0;
+
+	node_t* n = &_nodes[i];
+	n->expires = (_now + ns + TICK_NS - 1) / TICK_NS;
+	n->period = period;
+	n->cb = cb;
+	n->data = data;
+	add(i);
+
+	return make_id(n->generation, i);
+}
+
+// Spread the timers in one slot of level out over the levels below it
+static void cascade(int level, int32_t slot) {
+	int32_t list = level * SLOTS + slot;
+	int32_t i = _lists[list];
+	_lists[list] = NONE;
+
+	while (i != NONE) {
+		int32_t next = _nodes[i].next;
+		add(i);
+		i = next;
+	}
+}
+
+static void run_timers(uint64_t until) {
+	while (_tick <= until) {
+		int32_t slot = (int32_t)(_tick & (SLOTS - 1));
+
+		int level;
+		for (level = 1; level < LEVELS && ((_tick >> (SLOT_BITS * (level - 1))) & (SLOTS - 1)) == 0; level++)
+			cascade(level, (int32_t)((_tick >> (SLOT_BITS * level)) & (SLOTS - 1)));
+
+		_tick++;
+
+		// Moved aside first, so the callbacks can set and cancel timers freely
+		_lists[PENDING] = _lists[slot];
+		_lists[slot] = NONE;
+		int32_t i;
+		for (i = _lists[PENDING]; i != NONE; i = _nodes[i].next)
+			_nodes[i].list = PENDING;
+
+		while ((i = _lists[PENDING]) != NONE) {
+			node_t* n = &_nodes[i];
+			timerhandler_t cb = n->cb;
+			void* data = n->data;
+
+			unlink(i);
+			if (n->period) {
+				// At most once per frame, late ticks are not made up for
+				n->expires += n->period;
+				if (n->expires <= until)
+					n->expires = until + 1;
+				add(i);
+			} else {
+				free_node(i);
+			}
+
+			cb(data);
+		}
+	}
+}
+
+
+
+// --- Coroutines ---
+
+static void wake(void* data);
+
+static task_t* find_task(coroutine_id_t id) {
+	int32_t i = id_index(id);
+	if (i < 0 || i >= _taskCapacity || !_tasks[i].active || _tasks[i].generation != id_generation(id))
+		return NULL;
+	return &_tasks[i];
+}
+
+static void free_task(int32_t i) {
+	_tasks[i].active = false;
+	_tasks[i].generation++;
+	_tasks[i].nextFree = _freeTask;
+	_freeTask = i;
+}
+
+static void resume(coroutine_id_t id) {
+	task_t* t = find_task(id);
+	if (t == NULL)
+		return;
+
+	// A copy, the coroutine may start others and so move the tasks around
+	coroutine_t co = t->co;
+	co_status_t status = t->fn(&co);
+
+	t = find_task(id);
+	if (t == NULL)
+		return; // cancelled itself
+
+	t->co = co;
+	switch (status) {
+		case CO_NEXT_FRAME:
+			if (grow((void**)&_runnable, &_runnableCapacity, _runnableCount + 1, sizeof(coroutine_id_t))) {
+				_runnable[_runnableCount++] = id;
+				return;
+			}
+			break;
+		case CO_SLEEP:
+			t->timer = gdt_timer_after(co.sleep_ns, wake, (void*)(intptr_t)id_index(id));
+			if (t->timer)
+				return;
+			break;
+		case CO_DONE:
+			break;
+	}
+
+	free_task(id_index(id));
+}
+
+static void wake(void* data) {
+	int32_t i = (int32_t)(intptr_t)data;
+	_tasks[i].timer = 0;
+	resume(make_id(_tasks[i].generation, i));
+}
+
+// Take the coroutines that yielded last frame, before timers wake others up
+static int32_t take_runnable(void) {
+	coroutine_id_t* swap = _running;
+	_running = _runnable;
+	_runnable = swap;
+
+	int32_t capacity = _runningCapacity;
+	_runningCapacity = _runnableCapacity;
+	_runnableCapacity = capacity;
+
+	int32_t count = _runnableCount;
+	_runnableCount = 0;
+	return count;
+}
+
+
+
+uint64_t gdt_timer_now(void) {
+	return _now;
+}
+
+timer_id_t gdt_timer_after(uint64_t ns, timerhandler_t cb, void* data) {
+	return start_timer(ns, 0, cb, data);
+}
+
+timer_id_t gdt_timer_every(uint64_t ns, timerhandler_t cb, void* data) {
+	uint64_t period = (ns + TICK_NS - 1) / TICK_NS;
+	return start_timer(ns, period ? period : 1, cb, data);
+}
+
+bool gdt_timer_cancel(timer_id_t timer) {
+	int32_t i = id_index(timer);
+	if (i < 0 || i >= _nodeCapacity || _nodes[i].list == NONE || _nodes[i].generation != id_generation(timer))
+		return false;
+
+	unlink(i);
+	free_node(i);
+	return true;
+}
+
+coroutine_id_t gdt_co_start(cohandler_t fn, void* data) {
+	if (_freeTask == NONE) {
+		int32_t old = _taskCapacity;
+		if (!grow((void**)&_tasks, &_taskCapacity, old + 1, sizeof(task_t)))
+			return 0;
+
+		int32_t i;
+		for (i = _taskCapacity - 1; i >= old; i--) {
+			_tasks[i].generation = 1;
+			_tasks[i].active = false;
+			_tasks[i].nextFree = _freeTask;
+			_freeTask = i;
+		}
+	}
+
+	int32_t i = _freeTask;
+	task_t* t = &_tasks[i];
+	_freeTask = t->nextFree;
+
+	t->fn = fn;
+	t->co.line = 0;
+	t->co.sleep_ns = 0;
+	t->co.data = data;
+	t->active = true;
+	t->timer = 0;
+
+	coroutine_id_t id = make_id(t->generation, i);
+	resume(id);
+	return find_task(id) ? id : 0;
+}
+
+bool gdt_co_cancel(coroutine_id_t coroutine) {
+	task_t* t = find_task(coroutine);
+	if (t == NULL)
+		return false;
+
+	if (t->timer)
+		gdt_timer_cancel(t->timer);
+	free_task(id_index(coroutine));
+	return true;
+}
+
+
+
+void gdt_timer_advance(uint64_t time) {
+	if (_last)
+		_now += time - _last;
+	_last = time;
+
+	// Coroutines woken by timers run from the timer callback, and then not again this frame
+	int32_t count = take_runnable();
+
+	if (_listsReady)
+		run_timers(_now / TICK_NS);
+
+	int32_t i;
+	for (i = 0; i < count; i++)
+		resume(_running[i]);
+}
+
+void gdt_timer_pause(void) {
+	_last = 0;
+}
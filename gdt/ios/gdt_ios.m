@@ -26,6 +26,7 @@
 #import <UIKit/UIKit.h>
 
 #include <gdt/gdt.h>
+#include "../gdt_internal.h"
 #import <OpenGLES/EAGLDrawable.h> 
 #import <Foundation/Foundation.h>
 #import <QuartzCore/QuartzCore.h>
@@ -34,6 +35,7 @@
 #include <sys/mman.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/sysctl.h>
 #include <stdio.h>
 #include <sys/time.h>
 #import <UIKit/UIKit.h>
@@ -125,7 +127,7 @@ void gdt_set_callback_text(texthandler_t f) {
 
 static void text_input(string_t text) {
 	if (text_cb)
-		text_cb(text);
+		gdt_common_text(text_cb, text);
 }
 
 void gdt_set_callback_touch(touchhandler_t f) {
@@ -149,6 +151,10 @@ struct resource {
 	void*   data;
 };
 
+static const string_t* idPaths = NULL;
+static char** idFullPaths = NULL;
+static int32_t idCount = 0;
+
 void* gdt_resource_bytes(resource_t res) {
 	return res->data;
 }
@@ -157,12 +163,8 @@ int32_t gdt_resource_length(resource_t res) {
 	return res->len;
 }
 
-resource_t gdt_resource_load(string_t resourcePath) {
-	char* s;
-	asprintf(&s, "%s%s", resourceDir, resourcePath);
-	
-	int fd = open(s, O_RDONLY);
-	free(s);
+static resource_t map_file(string_t file) {
+	int fd = open(file, O_RDONLY);
 	if (fd == -1) return NULL;
 	resource_t res = (resource_t)malloc(sizeof(struct resource));
 	struct stat info;
@@ -171,9 +173,61 @@ resource_t gdt_resource_load(string_t resourcePath) {
 	res->data = mmap(NULL, res->len, PROT_READ, MAP_PRIVATE, fd, 0);
 	close(fd);
 	
+	if (gdt_prefetch_recording())
+		gdt_prefetch_note(file, 0, res->len);
+	
+	return res;
+}
+
+static resource_t map_dir_resource(string_t resourcePath) {
+	int32_t len;
+	void* data = gdt_resource_dir_map(resourcePath, &len);
+	if (data == NULL) return NULL;
+	resource_t res = (resource_t)malloc(sizeof(struct resource));
+	res->len = len;
+	res->data = data;
+	
+	return res;
+}
+
+resource_t gdt_resource_load(string_t resourcePath) {
+	resource_t res = map_dir_resource(resourcePath);
+	if (res) return res;
+
+	char* s;
+	asprintf(&s, "%s%s", resourceDir, resourcePath);
+	
+	res = map_file(s);
+	free(s);
+	
 	return res;
 }
 
+void gdt_resource_set_id_table(const string_t* resourcePaths, int32_t count) {
+	int32_t i;
+	for (i = 0; i < idCount; i++)
+		free(idFullPaths[i]);
+	free(idFullPaths);
+
+	idPaths = resourcePaths;
+	idCount = count;
+	idFullPaths = (char**)calloc(count, sizeof(char*));
+}
+
+resource_t gdt_resource_load_id(resource_id_t id) {
+	if (id < 0 || id >= idCount || idPaths[id] == NULL)
+		return NULL;
+
+	resource_t res = map_dir_resource(idPaths[id]);
+	if (res) return res;
+
+	// The full path is built once and kept for the next load of the same ID
+	if (idFullPaths[id] == NULL)
+		asprintf(&idFullPaths[id], "%s%s", resourceDir, idPaths[id]);
+
+	return map_file(idFullPaths[id]);
+}
+
 void gdt_resource_unload(resource_t resource) {	
 	munmap(gdt_resource_bytes(resource), gdt_resource_length(resource));
 	
@@ -226,8 +280,8 @@ string_t gdt_get_cache_directory_path(void) {
 
 
 -(void)visible:(BOOL)makeVisible {
-	if (makeVisible) gdt_hook_visible(false);
-	else gdt_hook_hidden();
+	if (makeVisible) gdt_common_visible(false);
+	else gdt_common_hidden();
 	
 	_visible = makeVisible? true : false;
 }
@@ -235,6 +289,17 @@ string_t gdt_get_cache_directory_path(void) {
 void gdt_gc_hint(void) {
 }
 
+static __thread NSAutoreleasePool* _threadPool = nil;
+
+void gdt_platform_thread_begin(void) {
+	_threadPool = [[NSAutoreleasePool alloc] init];
+}
+
+void gdt_platform_thread_end(void) {
+	[_threadPool release];
+	_threadPool = nil;
+}
+
 uint64_t gdt_time_ns(void) {
 	struct timeval now;
 	gettimeofday(&now, NULL);
@@ -248,6 +313,8 @@ uint64_t gdt_time_ns(void) {
 	self = [super initWithFrame:frame];
 	
 	if (self) {
+		gdt_startup_mark("GdtView initWithFrame");
+		
 		if ([[UIScreen mainScreen] respondsToSelector:@selector(scale)]) {
 			self.contentScaleFactor = [UIScreen mainScreen].scale;
 		}
@@ -284,6 +351,7 @@ uint64_t gdt_time_ns(void) {
 		
 		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRb);
 		glBindRenderbuffer(GL_RENDERBUFFER, rb);
+		gdt_startup_mark("framebuffer created");
 		
 		char* s;
 
@@ -295,13 +363,16 @@ uint64_t gdt_time_ns(void) {
 
 		asprintf(&s, "%s", [[NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) objectAtIndex:0] UTF8String]);
 		cacheDir = s;
+		gdt_startup_mark("storage paths");
         
 		_view = self;
 		_backspace = (string_t)malloc(1);
+		gdt_prefetch_launch();
 		gdt_hook_initialize();
+		gdt_startup_mark("gdt_hook_initialize");
 		_w = CGRectGetWidth(frame) * self.contentScaleFactor;
 		_h = CGRectGetHeight(frame) * self.contentScaleFactor;
-		gdt_hook_visible(true);
+		gdt_common_visible(true);
 		_visible = true;
 		
 		CADisplayLink* link = [CADisplayLink displayLinkWithTarget:self
@@ -321,9 +392,10 @@ uint64_t gdt_time_ns(void) {
 -(void)drawView:(CADisplayLink*)_
 {
 	if (_visible)
-		gdt_hook_render();
+		gdt_common_render();
 	
 	[ctx presentRenderbuffer:GL_RENDERBUFFER];
+	gdt_startup_frame_presented();
 }
 
 -(void)handleTouches:(NSSet*)touches withType:(touch_type_t)type 
@@ -331,7 +403,7 @@ uint64_t gdt_time_ns(void) {
 	if (touch_cb) {
 		CGFloat scale = self.contentScaleFactor;
 		CGPoint where = [[touches anyObject] locationInView:self];
-		touch_cb(type, where.x * scale, _h - where.y * scale);	
+		gdt_common_touch(touch_cb, type, where.x * scale, _h - where.y * scale);	
 	}
 }
 
@@ -382,12 +454,12 @@ uint64_t gdt_time_ns(void) {
 
 -(void)applicationDidBecomeActive:(UIApplication*)_
 {
-	gdt_hook_active();
+	gdt_common_active();
 }
 
 -(void)applicationWillResignActive:(UIApplication*)_
 {
-	gdt_hook_inactive();
+	gdt_common_inactive();
 }
 
 -(void)applicationWillEnterForeground:(UIApplication*)_
@@ -398,7 +470,7 @@ uint64_t gdt_time_ns(void) {
 -(void)applicationDidEnterBackground:(UIApplication*)_
 {
 	[view visible:NO];
-	gdt_hook_save_state();
+	gdt_common_save_state();
 }
 
 -(void)accelerometer:(UIAccelerometer*)_ didAccelerate:(UIAcceleration*)a {
@@ -408,7 +480,7 @@ uint64_t gdt_time_ns(void) {
 		v.y = a.y;
 		v.z = a.z;
 		v.time = a.timestamp;
-		cb_accelerometer(&v);
+		gdt_common_accelerometer(cb_accelerometer, &v);
 	}
 }
 
@@ -436,7 +508,24 @@ uint64_t gdt_time_ns(void) {
 
 
 
+// When the process was started, on the gdt_time_ns() clock, or 0 if unknown
+static uint64_t processStartTime(void) {
+	int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+	struct kinfo_proc info;
+	size_t len = sizeof(info);
+	if (sysctl(mib, 4, &info, &len, NULL, 0) == -1)
+		return 0;
+	
+	struct timeval t = info.kp_proc.p_starttime;
+	return (uint64_t) t.tv_sec * 1000000000LL + (uint64_t) t.tv_usec * 1000LL;
+}
+
 int main(int argc, char** argv) {
+	gdt_startup_mark("main");
+	uint64_t processStart = processStartTime();
+	if (processStart)
+		gdt_startup_mark_at("process start", processStart);
+	
 	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
 	int r = UIApplicationMain(argc, argv, nil, @"GdtAppDelegate");
 	[pool release];
@@ -76,6 +76,26 @@ typedef enum {
 struct resource;
 typedef struct resource* resource_t;
 
+// Index into the table registered with gdt_resource_set_id_table()
+typedef int32_t resource_id_t;
+
+/* A sprite packed into an atlas page by tools/gdt_atlas.c
+ * x, y, width and height are in pixels, from the top-left corner of the page.
+ * (u0, v0) is the bottom-left and (u1, v1) the top-right texture coordinate
+ * of the sprite, when the page is uploaded as stored (bottom row first).
+ */
+typedef struct {
+	resource_id_t page;
+	int16_t x;
+	int16_t y;
+	int16_t width;
+	int16_t height;
+	float u0;
+	float v0;
+	float u1;
+	float v1;
+} sprite_t;
+
 struct audioplayer;
 typedef struct audioplayer* audioplayer_t;
 
@@ -86,9 +106,44 @@ typedef struct {
 	double time; // in seconds
 } accelerometer_data_t; 
 
+#define GDT_FRAME_STATS_LONG_FRAMES 32
+
+typedef struct {
+	uint64_t time_ns;     // gdt_time_ns() when the frame started
+	uint32_t interval_us; // time since the previous frame started
+	uint32_t render_us;   // time spent in gdt_hook_render()
+} long_frame_t;
+
+typedef struct {
+	uint64_t frames;
+	double   interval_mean_us;
+	uint32_t interval_p50_us; // frame pacing, start to start
+	uint32_t interval_p90_us;
+	uint32_t interval_p99_us;
+	uint32_t interval_max_us;
+	uint32_t render_p50_us;   // time spent in gdt_hook_render()
+	uint32_t render_p90_us;
+	uint32_t render_p99_us;
+	uint32_t render_max_us;
+	uint64_t missed_vsyncs;
+	uint64_t long_frames;
+	int32_t  recent_long_frame_count;
+	long_frame_t recent_long_frames[GDT_FRAME_STATS_LONG_FRAMES]; // oldest first
+} frame_stats_t;
+
 typedef void (*accelerometerhandler_t)(accelerometer_data_t*);
 typedef void (*touchhandler_t)(touch_type_t, int, int);
 typedef void (*texthandler_t)(string_t);
+typedef void (*resourcechangedhandler_t)(string_t);
+typedef void (*simhandler_t)(uint64_t, void*);
+typedef void (*deferhandler_t)(void);
+
+#define GDT_STARTUP_MAX_PHASES 32
+
+typedef struct {
+	string_t name;
+	uint64_t time_ns; // since the first phase
+} startup_phase_t;
 
 #ifdef __cplusplus
 extern "C" {
@@ -194,6 +249,72 @@ void gdt_set_callback_touch(touchhandler_t on_touch);
 void gdt_set_callback_text(texthandler_t on_text_input);
 void gdt_set_callback_accelerometer(accelerometerhandler_t on_accelerometer_event);
 
+/* Receives the resourcePath of every resource that changed in the directory
+ * set with gdt_resource_set_directory(), just before gdt_hook_render().
+ * The old bytes of a loaded resource may be stale after this, so unload
+ * and load it again (and re-upload textures, shaders etc.).
+ * If the changes could not be tracked the path is "/", meaning everything.
+ */
+void gdt_set_callback_resource_changed(resourcechangedhandler_t on_resource_changed);
+
+
+// ------------------------------------
+
+
+/* --- Startup ---
+ * The runtime timestamps each phase of startup, from process start to the
+ * first frame being presented, and logs the breakdown once that happens.
+ *
+ * gdt_startup_mark -- Add a phase of your own, e.g. inside gdt_hook_initialize().
+ * phase is not copied. At most GDT_STARTUP_MAX_PHASES are kept.
+ *
+ * gdt_startup_phases -- Copy up to max phases, in time order, returns the count.
+ */
+void    gdt_startup_mark(string_t phase);
+int32_t gdt_startup_phases(startup_phase_t* phases, int32_t max);
+
+/* gdt_defer_init -- Postpone work that the first frame does not need.
+ * Queued functions run in order on the render thread (with the GL context)
+ * after the first frame has been presented, a couple of milliseconds'
+ * worth after every gdt_hook_render(), at least one per frame.
+ *
+ * gdt_defer_init_background -- The same, but run in order on a worker
+ * thread, so they must not use GL or game state without synchronization.
+ */
+void gdt_defer_init(deferhandler_t fn);
+void gdt_defer_init_background(deferhandler_t fn);
+
+// ------------------------------------
+
+
+/* --- Threaded simulation ---
+ * Opt-in mode where game logic runs on a dedicated native thread,
+ * overlapping with rendering instead of running before it on the GL thread.
+ *
+ * gdt_sim_start -- Start the simulation thread. on_step(stepNs, snapshot) is
+ * called every stepNs nanoseconds and must fill in the whole snapshot
+ * (snapshotSize bytes) with what the next frame should draw; the snapshot
+ * is published when on_step returns.
+ *
+ * From then on, the touch, text and accelerometer callbacks as well as
+ * gdt_hook_active(), gdt_hook_inactive() and gdt_hook_save_state() are
+ * called on the simulation thread, in order, between steps. They can safely
+ * touch the game state without locking.
+ * gdt_hook_visible(), gdt_hook_hidden() and gdt_hook_render() stay on the
+ * GL thread and run concurrently with the simulation, so gdt_hook_render()
+ * should draw from gdt_sim_snapshot() only. Stepping pauses while hidden.
+ *
+ * Call it from gdt_hook_initialize(). Returns false if the thread could not
+ * be started (or already is), in which case everything stays on the GL thread.
+ */
+bool gdt_sim_start(int32_t snapshotSize, uint64_t stepNs, simhandler_t on_step);
+
+/* gdt_sim_snapshot -- The most recently published snapshot, for gdt_hook_render().
+ * Never waits for the simulation. The snapshot stays untouched until the next
+ * call, and the same one is returned if no new one has been published since.
+ * NULL before the first step (or if not running the simulation thread).
+ */
+const void* gdt_sim_snapshot(void);
 
 // ------------------------------------
 
@@ -255,6 +376,77 @@ int32_t    gdt_resource_length(resource_t resource);
 resource_t gdt_resource_load  (string_t   resourcePath);
 void       gdt_resource_unload(resource_t resource);
 
+/* gdt_resource_set_id_table -- Register the resourcePaths that resource IDs
+ * refer to, typically a table generated by tools/gdt_atlas.c.
+ * Per-path work (building the full path or the Java string) is done once
+ * per ID and then reused, so gdt_resource_load_id() does no string handling.
+ * The table is not copied and must stay valid while IDs are in use.
+ */
+void       gdt_resource_set_id_table(const string_t* resourcePaths, int32_t count);
+resource_t gdt_resource_load_id(resource_id_t id);
+
+/* gdt_resource_set_directory -- Serve resources from a directory on the
+ * filesystem, before falling back to the bundled resources.
+ * Meant for development: push the assets to the device (or point the
+ * simulator at the project directory) and changes are picked up without
+ * repacking. The directory is watched and changes are reported through
+ * gdt_set_callback_resource_changed().
+ * Passing NULL goes back to only using the bundled resources.
+ */
+bool       gdt_resource_set_directory(string_t directoryPath);
+
+// -------------------------------------
+
+
+/* --- Resource prefetch ---
+ * The byte ranges of the resources loaded during a phase are recorded, in
+ * order, to "gdt_prefetch_<phase>.txt" in the cache directory. When the
+ * same phase begins on a later run, a background thread reads those ranges
+ * ahead into the page cache, so the game takes fewer page faults on cold
+ * storage when it gets to them.
+ *
+ * The "launch" phase is built in. It starts before gdt_hook_initialize()
+ * and lasts for the first GDT_PREFETCH_LAUNCH_NS, or until another phase
+ * begins, whichever comes first.
+ *
+ * gdt_prefetch_phase_begin -- Begin a named phase, e.g. "level3", before
+ * loading its resources. Ends the current phase, if any. phase is used
+ * in a file name, so keep it to letters, digits and '_'.
+ *
+ * gdt_prefetch_phase_end -- Stop recording and write the manifest.
+ * Also happens when the game is hidden.
+ */
+#define GDT_PREFETCH_LAUNCH_NS 10000000000ULL
+
+void gdt_prefetch_phase_begin(string_t phase);
+void gdt_prefetch_phase_end(void);
+
+// -------------------------------------
+
+
+/* --- Frame statistics ---
+ * Every gdt_hook_render() is timed, always. The durations go into fixed
+ * size histograms (about 3% precision), so the cost is a couple of
+ * timestamps and counter increments per frame.
+ * Time spent hidden is not counted.
+ *
+ * The statistics are also written to "gdt_frame_stats.txt" in the cache
+ * directory every minute and when the game is hidden, together with
+ * the device model, for collecting them from the field.
+ */
+
+void gdt_frame_stats(frame_stats_t* stats);
+void gdt_frame_stats_reset(void);
+
+/* gdt_frame_stats_configure -- Set the display refresh period, used to count
+ * missed vsyncs, and the interval from which a frame counts as a long frame.
+ * Passing 0 keeps the current value. Defaults: 60 Hz and 2.5 refresh periods.
+ */
+void gdt_frame_stats_configure(uint64_t vsyncNs, uint64_t longFrameNs);
+
+// Write the statistics to the cache directory right away, returns false on failure
+bool gdt_frame_stats_dump(void);
+
 // -------------------------------------
 
 
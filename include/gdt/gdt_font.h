@@ -0,0 +1,100 @@
+/*
+ * gdt_font.h
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef gdt_font_h
+#define gdt_font_h
+
+#include "gdt_gles2.h"
+
+/* --- Text ---
+ * Text in TrueType fonts (glyf outlines, .ttf), drawn as signed distance
+ * fields so that it stays sharp at any size from one small bitmap per
+ * glyph.
+ *
+ * Glyphs are made when first drawn, into an atlas shared by all fonts.
+ * When it is full, the glyph drawn longest ago makes room. The layout of
+ * every string drawn is cached, so text that stays the same from frame to
+ * frame costs little more than copying out its quads.
+ *
+ * gdt_font_draw() only queues text. gdt_font_flush() draws everything
+ * queued since the last flush, all fonts, sizes and colors, in one draw
+ * call, typically once at the end of gdt_hook_render() for the HUD.
+ *
+ * Positions are in pixels from the bottom-left corner of the surface, like
+ * touch events. Colors are 0xRRGGBBAA.
+ *
+ * The atlas and everything else on the GPU is made through the GL object
+ * registry. Only to be used on the render thread.
+ */
+
+struct font;
+typedef struct font* font_t;
+
+typedef struct {
+	uint64_t glyph_hits;
+	uint64_t glyph_misses;    // glyphs made, hits / (hits + misses) is the atlas hit rate
+	uint64_t glyph_evictions;
+	uint64_t glyph_dropped;   // not drawn, the atlas was full of glyphs drawn in the same frame
+	uint64_t glyph_ns;        // spent making glyphs
+	int32_t  glyphs_resident;
+	int32_t  glyph_capacity;
+	uint64_t layout_hits;
+	uint64_t layout_misses;
+	uint64_t draws;
+	uint64_t quads;
+} font_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // cplusplus
+
+// NULL if the resource is missing or not a TrueType font
+font_t gdt_font_open(string_t resourcePath);
+
+// Not while text in the font is queued
+void gdt_font_close(font_t font);
+
+/* gdt_font_draw -- Queue UTF-8 text, with the baseline of its first line
+ * starting at (x, y) and an em size pixels high. '\n' starts a new line.
+ * Glyphs not drawn before are put in the atlas now, which leaves the GL
+ * bindings and the unpack alignment as they were.
+ */
+void gdt_font_draw(font_t font, string_t text, float x, float y, float size, uint32_t rgba);
+
+// The size of text as drawn by gdt_font_draw(), from the left of the first line and the top of the font
+void gdt_font_measure(font_t font, string_t text, float size, float* width, float* height);
+
+/* gdt_font_flush -- Draw the queued text, blended over what is there.
+ * Leaves blending on and changes the program, the array and element array
+ * buffers, the texture bound to unit 0 and vertex attribute arrays 0-3.
+ */
+void gdt_font_flush(void);
+
+void gdt_font_stats(font_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif // cplusplus
+
+#endif // gdt_font_h
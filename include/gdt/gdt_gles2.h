@@ -37,4 +37,110 @@
 #include <OpenGLES/ES2/glext.h>
 #endif
 
+/* --- GL object registry ---
+ * All GL objects are gone when gdt_hook_visible() gets a new context.
+ * Objects created through the registry keep a recipe for making them
+ * again, so the runtime can bring them back by itself:
+ *   - all of them are marked lost before gdt_hook_visible(true)
+ *   - from the next frame on they are restored, highest priority first,
+ *     for a few milliseconds before every gdt_hook_render()
+ *   - gdt_gl_name() restores one right away if it is still lost, so an
+ *     object that is needed now is never missing, only slower to get
+ *
+ * Making an object, whether on creation, in gdt_gl_name() or when
+ * restoring, leaves the active texture unit, its GL_TEXTURE_2D binding,
+ * the GL_ARRAY_BUFFER and GL_ELEMENT_ARRAY_BUFFER bindings and
+ * GL_UNPACK_ALIGNMENT as they were, so bindings made once by the game
+ * stay good after a context loss. Recipes may bind anything on the active
+ * texture unit.
+ * gdt_gl_buffer_data(), _stream(), _map() and _unmap() do leave the buffer
+ * bound to its target.
+ *
+ * Only to be used on the render thread.
+ */
+
+struct globject;
+typedef struct globject* globject_t;
+
+// Makes the GL object, returns its name or 0 on failure
+typedef GLuint (*glrecipe_t)(void* data);
+
+typedef enum {
+	GLOBJECT_TEXTURE,
+	GLOBJECT_BUFFER,
+	GLOBJECT_PROGRAM
+} globject_type_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // cplusplus
+
+/* gdt_gl_texture -- A 2D texture from a TGA resource (true color or grey,
+ * optionally RLE compressed). Mipmaps are generated if minFilter uses them.
+ * The file is read again on restore, nothing is kept in memory.
+ */
+globject_t gdt_gl_texture(string_t resourcePath, GLenum minFilter, GLenum magFilter, GLenum wrap, int32_t priority);
+
+/* gdt_gl_buffer -- A buffer object with a copy of data kept for restoring.
+ * data may be NULL for buffers the game fills anew every frame anyway,
+ * they are restored with size bytes of undefined content.
+ */
+globject_t gdt_gl_buffer(GLenum target, const void* data, int32_t size, GLenum usage, int32_t priority);
+
+// Replace the contents, and the copy kept, of a buffer from gdt_gl_buffer()
+void gdt_gl_buffer_data(globject_t buffer, const void* data, int32_t size);
+
+/* gdt_gl_buffer_stream -- Replace the contents of a buffer from
+ * gdt_gl_buffer() for this frame only, without keeping a copy. The old
+ * storage is orphaned first, so there is no waiting for the GPU to be
+ * done drawing from it. The buffer never shrinks, it is restored with
+ * the largest size streamed into it.
+ */
+void gdt_gl_buffer_stream(globject_t buffer, const void* data, int32_t size);
+
+/* gdt_gl_buffer_map -- Like gdt_gl_buffer_stream(), but the game writes the
+ * contents straight into the orphaned storage instead of copying them in.
+ * Returns where to write size bytes, or NULL if the driver can not map
+ * buffers (OES_mapbuffer); gdt_gl_buffer_stream() is the way then.
+ * gdt_gl_buffer_unmap -- Done writing, before drawing from it. Returns
+ * false if the contents were lost meanwhile and have to be written again.
+ */
+void* gdt_gl_buffer_map(globject_t buffer, int32_t size);
+bool  gdt_gl_buffer_unmap(globject_t buffer);
+
+/* gdt_gl_program -- Compile and link a program from the two sources, which
+ * are copied. attributes[i] is bound to location i, so attribute locations
+ * survive a restore; uniform locations have to be looked up again.
+ */
+globject_t gdt_gl_program(string_t vertexSource, string_t fragmentSource,
+                          const string_t* attributes, int32_t attributeCount, int32_t priority);
+
+// Anything else, made by recipe(data). data must stay valid until deleted.
+globject_t gdt_gl_custom(globject_type_t type, glrecipe_t recipe, void* data, int32_t priority);
+
+/* gdt_gl_name -- The GL name of object, restoring it first if needed.
+ * 0 if it could not be made.
+ */
+GLuint gdt_gl_name(globject_t object);
+
+// Whether object is there without having to restore it first
+bool gdt_gl_ready(globject_t object);
+
+/* gdt_gl_generation -- Counts up every time object is made again, for
+ * keeping things derived from it (like uniform locations) up to date.
+ */
+uint32_t gdt_gl_generation(globject_t object);
+
+void gdt_gl_delete(globject_t object);
+
+// Objects still waiting to be restored, e.g. for showing a loading indicator
+int32_t gdt_gl_pending(void);
+
+// Time spent restoring before each gdt_hook_render(), default 4 ms. At least one object is restored per frame.
+void gdt_gl_set_restore_budget(uint64_t ns);
+
+#ifdef __cplusplus
+}
+#endif // cplusplus
+
 #endif // gles2_h
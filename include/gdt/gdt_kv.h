@@ -0,0 +1,90 @@
+/*
+ * gdt_kv.h
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef gdt_kv_h
+#define gdt_kv_h
+
+#include "gdt.h"
+
+/* --- Key-value store ---
+ * Persistent key-value storage in the storage directory, for settings,
+ * progress and the like, without rewriting whole files.
+ *
+ * A store is an append-only log, memory mapped, with an in-memory hash
+ * index on top:
+ *   - gdt_kv_put() appends one record into the mapping, O(1)
+ *   - gdt_kv_get() is a hash lookup that returns a pointer into the
+ *     mapping, nothing is copied (values are 8 byte aligned)
+ *   - every record has a CRC, so a record torn by a crash is detected
+ *     and dropped, along with anything after it, when the store is opened
+ *   - once more than half the log is overwritten or deleted records it
+ *     is compacted on a background thread, and swapped in by a later
+ *     gdt_kv_put(), gdt_kv_delete() or gdt_kv_sync()
+ *
+ * Writes survive the app being killed as soon as gdt_kv_put() returns.
+ * Surviving a power loss needs gdt_kv_sync(), a good place for it
+ * is gdt_hook_save_state().
+ *
+ * A store must only be used from one thread at a time.
+ */
+
+struct kvstore;
+typedef struct kvstore* kvstore_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // cplusplus
+
+/* gdt_kv_open -- Open (or create) the store <storage directory>/<name>.kv
+ * maxBytes is the largest the log may grow to, 0 for the default of 16 MB.
+ * That much address space is reserved up front so that the mapping never
+ * has to move. Returns NULL on failure.
+ */
+kvstore_t gdt_kv_open(string_t name, int32_t maxBytes);
+void      gdt_kv_close(kvstore_t kv);
+
+/* gdt_kv_get -- The value of key, or NULL if there is none.
+ * The pointer stays valid until the next gdt_kv_put(), gdt_kv_delete(),
+ * gdt_kv_sync() or gdt_kv_close() of the same store.
+ */
+const void* gdt_kv_get(kvstore_t kv, string_t key, int32_t* valueLength);
+
+/* gdt_kv_put -- Set key (non-empty) to a copy of value.
+ * Writing the value the key already has does nothing.
+ * Returns false if the store is full, even after compaction.
+ */
+bool gdt_kv_put(kvstore_t kv, string_t key, const void* value, int32_t valueLength);
+
+bool gdt_kv_delete(kvstore_t kv, string_t key);
+
+int32_t gdt_kv_count(kvstore_t kv);
+
+// Flush everything written so far to storage, returns false on failure
+bool gdt_kv_sync(kvstore_t kv);
+
+#ifdef __cplusplus
+}
+#endif // cplusplus
+
+#endif // gdt_kv_h
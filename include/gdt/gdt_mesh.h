@@ -0,0 +1,132 @@
+/*
+ * gdt_mesh.h
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef gdt_mesh_h
+#define gdt_mesh_h
+
+#include "gdt.h"
+
+/* --- Binary mesh format ---
+ * Written by tools/gdt_meshconv.c. Everything is little endian and laid
+ * out exactly as OpenGL ES wants it, so a mesh goes from
+ * gdt_resource_bytes() into glBufferData() with no parsing or copying:
+ *
+ *   mesh_header_t
+ *   vertex data  (at vertex_offset, 16 byte aligned, interleaved)
+ *   index data   (at index_offset, 4 byte aligned)
+ *
+ * Attributes may be quantized. A value read by the shader (after GL
+ * normalization, if normalized) is turned back into the original with
+ *   original = value * scale + bias
+ * where scale and bias are per attribute, typically passed as uniforms.
+ * For unquantized attributes scale is 1 and bias 0.
+ */
+
+#define GDT_MESH_MAGIC 0x4d544447 // "GDTM"
+#define GDT_MESH_VERSION 1
+#define GDT_MESH_MAX_ATTRIBUTES 8
+
+typedef enum {
+	MESH_POSITION,
+	MESH_NORMAL,
+	MESH_TEXCOORD,
+	MESH_COLOR,
+	MESH_SEMANTIC_COUNT
+} mesh_semantic_t;
+
+typedef struct {
+	uint8_t  semantic;   // mesh_semantic_t
+	uint8_t  size;       // number of components, 1-4
+	uint8_t  normalized;
+	uint8_t  offset;     // from the start of the vertex
+	uint32_t type;       // GL_FLOAT, GL_SHORT, GL_UNSIGNED_BYTE, ...
+	float    scale[4];
+	float    bias[4];
+} mesh_attribute_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t primitive;     // GL_TRIANGLES
+	uint32_t index_type;    // GL_UNSIGNED_SHORT
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t vertex_stride;
+	uint32_t vertex_offset; // from the start of the file
+	uint32_t index_offset;
+	uint32_t attribute_count;
+	float    bounds_min[3];
+	float    bounds_max[3];
+	mesh_attribute_t attributes[GDT_MESH_MAX_ATTRIBUTES];
+} mesh_header_t;
+
+
+#ifndef GDT_MESH_FORMAT_ONLY
+
+#include "gdt_gles2.h"
+
+// A view into a loaded mesh resource, valid as long as the resource is loaded
+typedef struct {
+	const mesh_header_t* header;
+	const void* vertices;
+	const void* indices;
+	int32_t vertex_bytes;
+	int32_t index_bytes;
+} mesh_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // cplusplus
+
+/* gdt_mesh_open -- Validate the mesh in resource and point mesh into it.
+ * Returns false if the resource is not a mesh of a supported version
+ * or is truncated.
+ */
+bool gdt_mesh_open(resource_t resource, mesh_t* mesh);
+
+// The attribute with the given semantic, or NULL if the mesh has none
+const mesh_attribute_t* gdt_mesh_attribute(const mesh_t* mesh, mesh_semantic_t semantic);
+
+/* gdt_mesh_upload -- glBufferData() the vertices into vertexBuffer and
+ * the indices into indexBuffer (GL_STATIC_DRAW), straight from the
+ * resource bytes. The buffers are left bound.
+ */
+void gdt_mesh_upload(const mesh_t* mesh, GLuint vertexBuffer, GLuint indexBuffer);
+
+/* gdt_mesh_bind -- Set up the vertex attribute pointers for the currently
+ * bound buffers. locations holds an attribute location per mesh_semantic_t,
+ * -1 for the ones the program does not use.
+ */
+void gdt_mesh_bind(const mesh_t* mesh, const GLint locations[MESH_SEMANTIC_COUNT]);
+
+// Draw the whole mesh from the currently bound buffers
+void gdt_mesh_draw(const mesh_t* mesh);
+
+#ifdef __cplusplus
+}
+#endif // cplusplus
+
+#endif // GDT_MESH_FORMAT_ONLY
+
+#endif // gdt_mesh_h
@@ -0,0 +1,146 @@
+/*
+ * gdt_particles.h
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef gdt_particles_h
+#define gdt_particles_h
+
+#include "gdt.h"
+
+/* --- Particles ---
+ * Emitters spawn particles at a rate (or in bursts) from a point, and
+ * every frame move them with their velocity, gravity and drag until their
+ * life is over. Size and color go from a start to an end value over the
+ * life of a particle.
+ *
+ * Particles are kept as separate arrays per attribute, so moving them and
+ * turning them into quads runs four at a time with NEON or SSE2 where the
+ * compiler targets it (define GDT_PARTICLES_SCALAR for plain C). Emitters
+ * with many particles can be split across worker threads, see
+ * gdt_particles_set_threads().
+ *
+ * Positions are in pixels from the bottom-left corner of the surface, like
+ * touch events. Colors are 0xRRGGBBAA with premultiplied alpha, so that an
+ * alpha of 0 gives additive particles and 255 ordinary ones.
+ *
+ * Define GDT_PARTICLES_HEADLESS to leave out drawing and everything GL,
+ * e.g. to benchmark on the host (tools/bench_particles.c).
+ *
+ * Emitters are not thread safe, use them from one thread at a time.
+ * Creating and destroying them makes no GL calls, so that can be done on
+ * any thread. The GL objects to draw with are made by the first
+ * gdt_particles_draw() and kept from then on.
+ */
+
+struct emitter;
+typedef struct emitter* emitter_t;
+
+typedef struct {
+	float    rate;      // particles per second
+	float    life_min;  // seconds
+	float    life_max;
+	float    speed_min; // pixels per second
+	float    speed_max;
+	float    direction; // radians, 0 is to the right, counter-clockwise
+	float    spread;    // radians to either side of direction
+	float    gravity_x; // pixels per second squared
+	float    gravity_y;
+	float    drag;      // fraction of the velocity lost per second, 0 to 1
+	float    size_start; // pixels across
+	float    size_end;
+	uint32_t color_start;
+	uint32_t color_end;
+} emitter_params_t;
+
+/* A vertex as written by gdt_emitter_write(). Particles come in groups of
+ * four, whose 16 vertices are ordered by corner and then by particle:
+ * corner k of particle 4 * g + j is vertex 16 * g + 4 * k + j. Corners go
+ * counter-clockwise from the bottom left, u and v are 0 or 255.
+ */
+typedef struct {
+	float   x, y;
+	uint8_t rgba[4];
+	uint8_t u, v;
+	uint8_t pad[2];
+} particle_vertex_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // cplusplus
+
+// At most capacity particles alive at once. NULL if out of memory.
+emitter_t gdt_emitter_create(const emitter_params_t* params, int32_t capacity);
+void      gdt_emitter_destroy(emitter_t emitter);
+
+// Takes effect for particles spawned from now on, except gravity and drag
+void gdt_emitter_set_params(emitter_t emitter, const emitter_params_t* params);
+void gdt_emitter_move(emitter_t emitter, float x, float y);
+
+// Spawn count particles at once, next update. Beyond capacity they are dropped.
+void gdt_emitter_burst(emitter_t emitter, int32_t count);
+
+// Advance by dt seconds: move and age the particles, then spawn new ones
+void gdt_emitter_update(emitter_t emitter, float dt);
+
+int32_t gdt_emitter_count(emitter_t emitter);
+
+/* gdt_emitter_write -- Write the quads of all particles alive, four
+ * vertices each, ordered as described for particle_vertex_t. The count
+ * is rounded up to a multiple of four, the quads for the missing
+ * particles have no area. Returns how many quads were written, vertices
+ * must have room for 4 * (gdt_emitter_count() + 3) vertices.
+ */
+int32_t gdt_emitter_write(emitter_t emitter, particle_vertex_t* vertices);
+
+/* gdt_particles_set_threads -- Let updating and writing particles of large
+ * emitters (several thousands) use up to count worker threads besides the
+ * calling one. 0, the default, does it all on the calling thread. Not to
+ * be called while an emitter is being updated or drawn.
+ */
+void gdt_particles_set_threads(int32_t count);
+
+// "neon", "sse2" or "scalar", what the particles are processed with
+string_t gdt_particles_simd(void);
+
+#ifndef GDT_PARTICLES_HEADLESS
+
+#include "gdt_gles2.h"
+
+/* gdt_particles_draw -- Draw the particles of the emitters, all in one
+ * go, blended with premultiplied alpha. The quads are written straight
+ * into a streaming buffer where the driver can map it. texture is
+ * sampled over each quad, 0 draws soft round particles.
+ * Leaves blending on and changes the program, the array and element array
+ * buffers, the texture bound to unit 0 (with a texture) and vertex
+ * attribute arrays 0-2.
+ * Only to be used on the render thread.
+ */
+void gdt_particles_draw(const emitter_t* emitters, int32_t count, GLuint texture);
+
+#endif // GDT_PARTICLES_HEADLESS
+
+#ifdef __cplusplus
+}
+#endif // cplusplus
+
+#endif // gdt_particles_h
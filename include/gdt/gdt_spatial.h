@@ -0,0 +1,84 @@
+/*
+ * gdt_spatial.h
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef gdt_spatial_h
+#define gdt_spatial_h
+
+#include "gdt.h"
+
+/* --- Spatial index ---
+ * Finds the objects at a point (what was touched) or in a rectangle (what
+ * is visible) without looking at all of them. Objects are rectangles in
+ * pixels from the bottom-left corner, like touch events, that contain
+ * their left and bottom edges but not their right and top ones.
+ *
+ * The plane is cut into square cells, and every object is listed in the
+ * cells it overlaps. Objects that would cover many cells go in a coarser
+ * grid instead, there are a few, each 8 times coarser than the one before.
+ * A point query looks at one cell per grid, a rectangle query at the
+ * cells it covers. Cells are hashed, so the plane has no bounds.
+ *
+ * Moving an object within the cells it already covers only updates its
+ * rectangle. Pick a cell size around the size of a typical object.
+ *
+ * Not thread safe, use an index from one thread at a time.
+ */
+
+struct spatial;
+typedef struct spatial* spatial_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // cplusplus
+
+// NULL if out of memory
+spatial_t gdt_spatial_create(float cellSize);
+void      gdt_spatial_destroy(spatial_t index);
+
+/* gdt_spatial_insert -- Add an object, returns its ID or -1 if out of memory.
+ * IDs are small integers, reused after gdt_spatial_remove(). When objects
+ * overlap, the one with the highest z is on top, and of those with the
+ * same z the one inserted last.
+ */
+int32_t gdt_spatial_insert(spatial_t index, float x, float y, float width, float height, int32_t z, void* data);
+void    gdt_spatial_move(spatial_t index, int32_t id, float x, float y, float width, float height);
+void    gdt_spatial_remove(spatial_t index, int32_t id);
+void*   gdt_spatial_data(spatial_t index, int32_t id);
+
+// The topmost object at (x, y), e.g. from a touch event, or -1 if there is none
+int32_t gdt_spatial_pick(spatial_t index, float x, float y);
+
+/* gdt_spatial_query -- The objects overlapping the rectangle, in no
+ * particular order. Writes up to max IDs to ids and returns how many
+ * there are in all, which can be more than max.
+ */
+int32_t gdt_spatial_query(spatial_t index, float x, float y, float width, float height, int32_t* ids, int32_t max);
+
+int32_t gdt_spatial_count(spatial_t index);
+
+#ifdef __cplusplus
+}
+#endif // cplusplus
+
+#endif // gdt_spatial_h
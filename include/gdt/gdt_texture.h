@@ -0,0 +1,140 @@
+/*
+ * gdt_texture.h
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef gdt_texture_h
+#define gdt_texture_h
+
+#include "gdt.h"
+
+/* --- Mip chain texture format ---
+ * Written by tools/gdt_texconv.c. Little endian, every level ready for
+ * glTexImage2D() (rows bottom first, tightly packed) down to 1x1:
+ *
+ *   texture_header_t
+ *   level data, smallest level first, each at a 16 byte aligned offset
+ *
+ * Smallest first keeps the levels that are always resident together at
+ * the start of the file, the large ones are only read if they are needed.
+ */
+
+#define GDT_TEXTURE_MAGIC 0x54544447 // "GDTT"
+#define GDT_TEXTURE_VERSION 1
+#define GDT_TEXTURE_MAX_LEVELS 16
+
+typedef struct {
+	uint32_t offset; // from the start of the file
+	uint32_t size;
+} texture_level_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format; // GL_RGBA, GL_RGB or GL_LUMINANCE
+	uint32_t type;   // GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT_5_6_5 or GL_UNSIGNED_SHORT_4_4_4_4
+	uint32_t width;  // of level 0
+	uint32_t height;
+	uint32_t level_count;
+	texture_level_t levels[GDT_TEXTURE_MAX_LEVELS]; // levels[0] is the largest
+} texture_header_t;
+
+
+#ifndef GDT_TEXTURE_FORMAT_ONLY
+
+#include "gdt_gles2.h"
+
+/* --- Texture streaming ---
+ * A streamed texture starts out with only its small levels (32x32 and
+ * down) resident. Every frame the game reports how large each texture it
+ * draws is on screen, and before the next frame the runtime brings in
+ * more detail where it is needed, one level at a time, within a couple
+ * of milliseconds per frame.
+ *
+ * The levels resident on the GPU across all streamed textures are kept
+ * within a budget. To make room, textures that have not been needed for
+ * the longest time give up their large levels first, and textures with
+ * more detail than they currently need come next.
+ *
+ * The texture resource stays mapped while open, so levels that are never
+ * needed are never read from storage. GLES2 has no base level, so
+ * changing the resident levels specifies the texture anew from the mapped
+ * levels; this is cheap next to the largest level, which dominates.
+ *
+ * Streamed textures are made through the GL object registry, so they are
+ * restored after a context loss like everything else. Levels are brought
+ * in and given up before gdt_hook_render(), which leaves the texture
+ * bindings and the unpack alignment as the game left them.
+ * Only to be used on the render thread.
+ */
+
+struct texture;
+typedef struct texture* texture_t;
+
+typedef struct {
+	int32_t  textures;
+	int32_t  pending;        // textures needed with more detail than they have
+	int64_t  resident_bytes; // on the GPU
+	int64_t  wanted_bytes;   // if every texture had the detail it needs
+	int64_t  budget_bytes;
+	uint64_t uploads;        // times a texture was specified
+	uint64_t upload_bytes;
+	uint64_t evictions;      // times a texture gave up levels for the budget
+} texture_stats_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif // cplusplus
+
+/* gdt_texture_open -- Start streaming a texture from tools/gdt_texconv.c.
+ * Filtering is trilinear. Returns NULL if the resource is missing or not
+ * a supported texture, which includes sizes that are not powers of two
+ * unless the context has OES_texture_npot.
+ */
+texture_t gdt_texture_open(string_t resourcePath, GLenum wrap);
+void      gdt_texture_close(texture_t texture);
+
+// What to bind, it always has at least the small levels
+GLuint gdt_texture_name(texture_t texture);
+
+/* gdt_texture_need -- Report that texture is drawn this frame, screenSize
+ * pixels across at most (in texels of level 0, as wide as it gets on
+ * screen). Higher priority textures get their detail first. It can be
+ * reported several times a frame, the largest size counts.
+ */
+void gdt_texture_need(texture_t texture, float screenSize, int32_t priority);
+
+// The most detailed level resident, 0 for full detail
+int32_t gdt_texture_level(texture_t texture);
+
+// Default 32 MB
+void gdt_texture_set_budget(int64_t bytes);
+
+void gdt_texture_stats(texture_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif // cplusplus
+
+#endif // GDT_TEXTURE_FORMAT_ONLY
+
+#endif // gdt_texture_h
@@ -0,0 +1,133 @@
+/*
+ * gdt_timer.h
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef gdt_timer_h
+#define gdt_timer_h
+
+#include "gdt.h"
+
+/* --- Timers and coroutines ---
+ * Driven by the runtime once per frame, just before gdt_hook_render(),
+ * on the render thread; that is also the only thread they may be used from.
+ *
+ * They run on the game clock, gdt_timer_now(), which stands still while the
+ * game is hidden. A timer set to 2 s that has 1 s left when the game is
+ * hidden fires 1 s after it is visible again.
+ *
+ * Timers live in a hierarchical timer wheel with millisecond ticks.
+ * Setting and cancelling are O(1) and a frame only looks at the timers that
+ * are due, so thousands of pending timers cost next to nothing. A timer
+ * fires in the first frame at or after its time.
+ */
+
+// 0 is never a valid ID, so it can be used for "none"
+typedef uint64_t timer_id_t;
+typedef uint64_t coroutine_id_t;
+
+typedef void (*timerhandler_t)(void* data);
+
+/* Stackless coroutines, resumed by the runtime every frame (or when a wait
+ * is over) from where they left off:
+ *
+ *   static co_status_t intro(coroutine_t* co) {
+ *       intro_t* s = co->data;
+ *       GDT_CO_BEGIN(co);
+ *       show_logo(s);
+ *       GDT_CO_WAIT(co, 2000000000);        // two seconds
+ *       for (s->i = 0; s->i < 30; s->i++) {
+ *           fade_logo(s, s->i / 30.0f);
+ *           GDT_CO_YIELD(co);               // until the next frame
+ *       }
+ *       GDT_CO_UNTIL(co, s->loaded);        // checked every frame
+ *       GDT_CO_END(co);
+ *   }
+ *
+ *   gdt_co_start(intro, &introState);
+ *
+ * Locals do not survive a yield, keep state in data. The macros expand to
+ * a switch, so the body itself can not use switch around them, and there
+ * can be only one of them per line.
+ */
+typedef enum {
+	CO_NEXT_FRAME,
+	CO_SLEEP,
+	CO_DONE
+} co_status_t;
+
+typedef struct {
+	int32_t  line;     // where to resume, kept by the macros
+	uint64_t sleep_ns; // set by GDT_CO_WAIT
+	void*    data;     // as passed to gdt_co_start()
+} coroutine_t;
+
+typedef co_status_t (*cohandler_t)(coroutine_t* co);
+
+#define GDT_CO_BEGIN(co) switch ((co)->line) { case 0:
+
+#define GDT_CO_YIELD(co) \
+	do { (co)->line = __LINE__; return CO_NEXT_FRAME; case __LINE__:; } while (0)
+
+#define GDT_CO_WAIT(co, ns) \
+	do { (co)->line = __LINE__; (co)->sleep_ns = (ns); return CO_SLEEP; case __LINE__:; } while (0)
+
+#define GDT_CO_UNTIL(co, condition) \
+	do { (co)->line = __LINE__; case __LINE__: if (!(condition)) return CO_NEXT_FRAME; } while (0)
+
+#define GDT_CO_END(co) } (co)->line = 0; return CO_DONE
+
+#ifdef __cplusplus
+extern "C" {
+#endif // cplusplus
+
+// The game clock, in nanoseconds. Advances once per frame and not while hidden.
+uint64_t gdt_timer_now(void);
+
+/* gdt_timer_after -- Call cb(data) once, ns from now.
+ * gdt_timer_every -- Call cb(data) every ns, until cancelled. If frames
+ * are slower than that it is called once per frame, not to catch up.
+ * Both return 0 if out of memory.
+ */
+timer_id_t gdt_timer_after(uint64_t ns, timerhandler_t cb, void* data);
+timer_id_t gdt_timer_every(uint64_t ns, timerhandler_t cb, void* data);
+
+/* gdt_timer_cancel -- Returns false if the timer already fired (and does not
+ * repeat) or was cancelled. Safe to call from any timer callback, also for
+ * the timer being called.
+ */
+bool gdt_timer_cancel(timer_id_t timer);
+
+/* gdt_co_start -- Run fn with data until its first yield or wait, and resume
+ * it from there on until it gets to GDT_CO_END. Returns 0 if out of memory
+ * or if the coroutine ended without yielding.
+ */
+coroutine_id_t gdt_co_start(cohandler_t fn, void* data);
+
+// Never resume it again. Returns false if it already ended.
+bool gdt_co_cancel(coroutine_id_t coroutine);
+
+#ifdef __cplusplus
+}
+#endif // cplusplus
+
+#endif // gdt_timer_h
@@ -58,6 +58,10 @@ float _y = 0.5;
 int _width;
 int _height;
 GLuint _offsetUniform;
+uint32_t _programGeneration;
+globject_t _program = NULL;
+globject_t _vertexBuf;
+globject_t _indexBuf;
 string_t SAVE_FILE = "state";
 string_t _save_path;
 
@@ -67,42 +71,7 @@ string_t _save_path;
 
 
 
-static GLuint compileShader(string_t shaderCode, GLenum type) {
-	GLuint shader = glCreateShader(type);
-
-	int len = strlen(shaderCode);
-	glShaderSource(shader, 1, &shaderCode, &len);
-
-	glCompileShader(shader);
-
-	GLint result;
-	glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
-	if (result == GL_FALSE) {
-		gdt_fatal(TAG, "Error compiling shader");
-	}
-
-	return shader;
-}
-
-static GLuint linkProgram() {
-	GLuint vertexShader = compileShader(simpleVertexShader, GL_VERTEX_SHADER);
-	GLuint fragmentShader = compileShader(redFragmentShader, GL_FRAGMENT_SHADER);
-
-	GLuint program = glCreateProgram();
-
-	glAttachShader(program, vertexShader);
-	glAttachShader(program, fragmentShader);
-
-	glLinkProgram(program);
-
-	GLint result;
-	glGetProgramiv(program, GL_LINK_STATUS, &result);
-	if (result == GL_FALSE) {
-		gdt_fatal(TAG, "Error linking program");
-	}
-
-	return program;
-}
+static string_t attributes[] = { "position" }; // bound to location 0
 
 static bool inside_the_square(float x, float y) {
 	return (x > _x && x < (_x + SIZE)) && (y > _y && y < (_y + SIZE));
@@ -216,33 +185,22 @@ void gdt_hook_visible(bool newContext) {
 		
 		LOG("surface size: width=%d, height=%d", _width, _height);
 		
-		GLuint program = linkProgram();
-
-		_offsetUniform = glGetUniformLocation(program, "offset");
-		GLuint positionAttrib = glGetAttribLocation(program, "position");
-
-		static const GLfloat v[] = {
-			0, SIZE,
-			0, 0,
-			SIZE, SIZE,
-			SIZE, 0
-		};
-		
-		GLuint vertexBuf;
-		glGenBuffers(1, &vertexBuf);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexBuf);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(v), v, GL_STATIC_DRAW);
-
-		static const GLubyte i[] = { 0, 1, 2, 3 };
-		GLuint indexBuf;
-		glGenBuffers(1, &indexBuf);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuf);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(i), i, GL_STATIC_DRAW);
-
-		glEnableVertexAttribArray(positionAttrib);
-		glVertexAttribPointer(positionAttrib, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
-
-		glUseProgram(program);
+		// Made once, the registry makes them again whenever the context is new
+		if (_program == NULL) {
+			_program = gdt_gl_program(simpleVertexShader, redFragmentShader, attributes, 1, 1);
+			ASSERT(_program != NULL);
+
+			static const GLfloat v[] = {
+				0, SIZE,
+				0, 0,
+				SIZE, SIZE,
+				SIZE, 0
+			};
+			_vertexBuf = gdt_gl_buffer(GL_ARRAY_BUFFER, v, sizeof(v), GL_STATIC_DRAW, 0);
+
+			static const GLubyte i[] = { 0, 1, 2, 3 };
+			_indexBuf = gdt_gl_buffer(GL_ELEMENT_ARRAY_BUFFER, i, sizeof(i), GL_STATIC_DRAW, 0);
+		}
 
 		glClearColor(0.4, 0.8, 0.4, 1);
 		
@@ -290,6 +248,17 @@ void gdt_hook_render() {
 
 	glClear(GL_COLOR_BUFFER_BIT);
 
+	glUseProgram(gdt_gl_name(_program));
+	if (_programGeneration != gdt_gl_generation(_program)) {
+		_programGeneration = gdt_gl_generation(_program);
+		_offsetUniform = glGetUniformLocation(gdt_gl_name(_program), "offset");
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, gdt_gl_name(_vertexBuf));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gdt_gl_name(_indexBuf));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
+
 	glUniform2f(_offsetUniform, _x, _y);
 	glDrawElements(GL_TRIANGLE_STRIP, 4, GL_UNSIGNED_BYTE, NULL); 
 }
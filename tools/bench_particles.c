@@ -0,0 +1,148 @@
+/*
+ * bench_particles.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* bench_particles -- Benchmark of gdt_particles.c, run on the build host or
+ * on a device (it needs nothing but a C library).
+ *
+ * Runs a fountain of 10k to 100k particles at 60 frames per second until it
+ * is full, then times updating the particles and writing their quads every
+ * frame, on the calling thread alone and with worker threads. Build it
+ * once more with -DGDT_PARTICLES_SCALAR to compare against plain C.
+ *
+ *   cc -O2 -Iinclude -DGDT_PARTICLES_HEADLESS -o bench_particles tools/bench_particles.c gdt/gdt_particles.c -lm -lpthread
+ *   bench_particles [threads]
+ */
+
+#include <gdt/gdt_particles.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WARMUP_FRAMES 240
+#define FRAMES 300
+#define DT (1.0f / 60.0f)
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Quads of a particle are square and the same in all four corners
+static bool check(const particle_vertex_t* v, int32_t quads, int32_t alive) {
+	int32_t i;
+	for (i = 0; i < quads; i++) {
+		const particle_vertex_t* c = v + 16 * (i / 4) + i % 4;
+		if (c[0].x != c[12].x || c[4].x != c[8].x || c[0].y != c[4].y || c[8].y != c[12].y ||
+		    c[0].u != 0 || c[4].u != 255 || c[8].v != 255 || c[12].v != 255 ||
+		    memcmp(c[0].rgba, c[8].rgba, 4) != 0)
+			return false;
+		if (i >= alive && (c[0].x != c[8].x || c[0].rgba[3] != 0))
+			return false;
+	}
+	return true;
+}
+
+static void run(int32_t n, int32_t threads, particle_vertex_t* vertices) {
+	emitter_params_t p = {
+		.rate = n / 2.0f,
+		.life_min = 1.5f,
+		.life_max = 2.5f,
+		.speed_min = 200.0f,
+		.speed_max = 400.0f,
+		.direction = 1.5708f,
+		.spread = 0.4f,
+		.gravity_y = -300.0f,
+		.drag = 0.2f,
+		.size_start = 8.0f,
+		.size_end = 24.0f,
+		.color_start = 0xffc040ff,
+		.color_end = 0x40101000
+	};
+
+	gdt_particles_set_threads(threads);
+	emitter_t e = gdt_emitter_create(&p, n);
+	if (e == NULL) {
+		fprintf(stderr, "bench_particles: out of memory\n");
+		exit(1);
+	}
+	gdt_emitter_move(e, 960.0f, 100.0f);
+
+	int32_t i;
+	for (i = 0; i < WARMUP_FRAMES; i++)
+		gdt_emitter_update(e, DT);
+
+	double update = 0, write = 0;
+	int64_t particles = 0;
+	for (i = 0; i < FRAMES; i++) {
+		double t0 = now();
+		gdt_emitter_update(e, DT);
+		double t1 = now();
+		int32_t quads = gdt_emitter_write(e, vertices);
+		double t2 = now();
+		update += t1 - t0;
+		write += t2 - t1;
+		particles += gdt_emitter_count(e);
+
+		if (i == 0 && !check(vertices, quads, gdt_emitter_count(e))) {
+			fprintf(stderr, "bench_particles: bad quads\n");
+			exit(1);
+		}
+	}
+
+	printf("%9d %7d %10.1f %10.1f %12.0f\n", (int)(particles / FRAMES), threads,
+	       update / FRAMES * 1e6, write / FRAMES * 1e6, particles / ((update + write) * 1e3));
+	gdt_emitter_destroy(e);
+}
+
+int main(int argc, char** argv) {
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int32_t threads = argc > 1 ? atoi(argv[1]) : (cpus > 1 ? (int32_t)cpus - 1 : 0);
+	if (argc > 2 || threads < 0) {
+		fprintf(stderr, "usage: bench_particles [threads]\n");
+		return 1;
+	}
+
+	static const int32_t sizes[] = { 10000, 50000, 100000 };
+	particle_vertex_t* vertices = (particle_vertex_t*)malloc((100000 + 3) * 4 * sizeof(particle_vertex_t));
+	if (vertices == NULL) {
+		fprintf(stderr, "bench_particles: out of memory\n");
+		return 1;
+	}
+
+	printf("%s, %d frames at %.0f Hz\n", gdt_particles_simd(), FRAMES, 1.0f / DT);
+	printf("%9s %7s %10s %10s %12s\n", "particles", "threads", "update us", "write us", "particles/ms");
+	int32_t i;
+	for (i = 0; i < 3; i++) {
+		run(sizes[i], 0, vertices);
+		if (threads > 0)
+			run(sizes[i], threads, vertices);
+	}
+
+	gdt_particles_set_threads(0);
+	free(vertices);
+	return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * bench_spatial.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* bench_spatial -- Benchmark of gdt_spatial.c, run on the build host.
+ *
+ * Fills a 8192x8192 pixel world with 10k to 100k objects (mostly sprite
+ * sized, some larger, four covering everything), then times inserting,
+ * moving, picking random points and querying a 1920x1080 view, against
+ * linear scans over all objects. Results are checked against the scans.
+ *
+ *   cc -O2 -Iinclude -o bench_spatial tools/bench_spatial.c gdt/gdt_spatial.c -lm
+ *   bench_spatial [cellSize]
+ */
+
+#include <gdt/gdt_spatial.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WORLD 8192
+#define VIEW_W 1920
+#define VIEW_H 1080
+#define PICKS 10000
+#define QUERIES 200
+
+typedef struct {
+	float x, y, w, h;
+	int32_t z;
+	int32_t id;
+} object;
+
+static object* objects;
+static int32_t* found;
+static uint32_t rng = 2463534242u;
+
+
+static uint32_t next(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static float uniform(float lo, float hi) {
+	return lo + (hi - lo) * (next() & 0xffffff) / 16777216.0f;
+}
+
+static double now(void) {
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Same answer as gdt_spatial_pick(), the latest inserted wins ties in z
+static int32_t linear_pick(int n, float x, float y) {
+	int32_t best = -1;
+	int i;
+	for (i = 0; i < n; i++) {
+		const object* o = &objects[i];
+		if (x >= o->x && x < o->x + o->w && y >= o->y && y < o->y + o->h &&
+		    (best < 0 || o->z >= objects[best].z))
+			best = i;
+	}
+	return best < 0 ? -1 : objects[best].id;
+}
+
+static int32_t linear_query(int n, float x, float y, float w, float h) {
+	int32_t count = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		const object* o = &objects[i];
+		if (o->x < x + w && x < o->x + o->w && o->y < y + h && y < o->y + o->h)
+			count++;
+	}
+	return count;
+}
+
+static void run(int n, float cellSize) {
+	spatial_t index = gdt_spatial_create(cellSize);
+	int i, j;
+
+	double t = now();
+	for (i = 0; i < n; i++) {
+		object* o = &objects[i];
+		bool background = i < 4;
+		bool large = next() % 100 < 2;
+		o->w = background ? WORLD : large ? uniform(256, 1024) : uniform(16, 96);
+		o->h = background ? WORLD : large ? uniform(256, 1024) : uniform(16, 96);
+		o->x = background ? 0 : uniform(0, WORLD - o->w);
+		o->y = background ? 0 : uniform(0, WORLD - o->h);
+		o->z = background ? -1 : (int32_t)(next() % 8);
+		o->id = gdt_spatial_insert(index, o->x, o->y, o->w, o->h, o->z, o);
+		if (o->id < 0) {
+			fprintf(stderr, "bench_spatial: out of memory\n");
+			exit(1);
+		}
+	}
+	double insert = now() - t;
+
+	// A tenth of the objects drift a few pixels, like a frame of animation
+	int moves = n / 10;
+	t = now();
+	for (j = 0; j < 10; j++) {
+		for (i = 0; i < moves; i++) {
+			object* o = &objects[next() % n];
+			if (o->w >= WORLD)
+				continue;
+			o->x += uniform(-4, 4);
+			o->y += uniform(-4, 4);
+			gdt_spatial_move(index, o->id, o->x, o->y, o->w, o->h);
+		}
+	}
+	double move = (now() - t) / 10;
+
+	float* points = malloc(2 * PICKS * sizeof(float));
+	int32_t* picked = malloc(PICKS * sizeof(int32_t));
+	for (i = 0; i < PICKS; i++) {
+		points[2 * i] = uniform(0, WORLD);
+		points[2 * i + 1] = uniform(0, WORLD);
+	}
+
+	t = now();
+	for (i = 0; i < PICKS; i++)
+		picked[i] = gdt_spatial_pick(index, points[2 * i], points[2 * i + 1]);
+	double pick = (now() - t) / PICKS;
+
+	int picks = PICKS / 10;
+	t = now();
+	for (i = 0; i < picks; i++)
+		if (linear_pick(n, points[2 * i], points[2 * i + 1]) != picked[i]) {
+			fprintf(stderr, "bench_spatial: pick %d differs\n", i);
+			exit(1);
+		}
+	double linearPick = (now() - t) / picks;
+
+	float* views = malloc(2 * QUERIES * sizeof(float));
+	int32_t* counts = malloc(QUERIES * sizeof(int32_t));
+	for (i = 0; i < QUERIES; i++) {
+		views[2 * i] = uniform(0, WORLD - VIEW_W);
+		views[2 * i + 1] = uniform(0, WORLD - VIEW_H);
+	}
+
+	t = now();
+	int64_t visible = 0;
+	for (i = 0; i < QUERIES; i++) {
+		counts[i] = gdt_spatial_query(index, views[2 * i], views[2 * i + 1], VIEW_W, VIEW_H, found, n);
+		visible += counts[i];
+	}
+	double query = (now() - t) / QUERIES;
+
+	t = now();
+	for (i = 0; i < QUERIES; i++)
+		if (linear_query(n, views[2 * i], views[2 * i + 1], VIEW_W, VIEW_H) != counts[i]) {
+			fprintf(stderr, "bench_spatial: query %d differs\n", i);
+			exit(1);
+		}
+	double linearQuery = (now() - t) / QUERIES;
+
+	printf("%7d %10.0f %10.0f %10.2f %10.2f %10.1f %10.1f %10d\n", n,
+	       insert / n * 1e9, move / moves * 1e9, pick * 1e6, linearPick * 1e6,
+	       query * 1e6, linearQuery * 1e6, (int)(visible / QUERIES));
+
+	free(points);
+	free(picked);
+	free(views);
+	free(counts);
+	gdt_spatial_destroy(index);
+}
+
+int main(int argc, char** argv) {
+	static const int sizes[] = { 10000, 30000, 100000 };
+	float cellSize = argc > 1 ? (float)atof(argv[1]) : 128;
+	int i;
+
+	if (cellSize <= 0) {
+		fprintf(stderr, "usage: bench_spatial [cellSize]\n");
+		return 2;
+	}
+
+	objects = malloc(sizes[2] * sizeof(object));
+	found = malloc(sizes[2] * sizeof(int32_t));
+
+	printf("cell size %.0f, world %dx%d, view %dx%d\n", cellSize, WORLD, WORLD, VIEW_W, VIEW_H);
+	printf("%7s %10s %10s %10s %10s %10s %10s %10s\n", "objects", "insert ns", "move ns",
+	       "pick us", "scan us", "view us", "scan us", "visible");
+	for (i = 0; i < 3; i++)
+		run(sizes[i], cellSize);
+	return 0;
+}
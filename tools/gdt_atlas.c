@@ -0,0 +1,555 @@
+/*
+ * gdt_atlas.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* gdt_atlas -- Offline sprite atlas packer, run on the build host.
+ *
+ * Packs TGA sprites into as few atlas pages as possible (MaxRects, best
+ * short side fit) and writes the pages as TGA files together with a C
+ * header of sprite and page IDs, so that the game never has to deal with
+ * sprite paths at runtime:
+ *
+ *   cc -O2 -o gdt_atlas tools/gdt_atlas.c
+ *   gdt_atlas -n ui -r /atlas assets/atlas src/ui_atlas.h sprites/ui/player.tga ...
+ *
+ * gives assets/atlas/ui_0.tga, ... and src/ui_atlas.h with
+ *
+ *   enum { UI_PAGE_0, ..., UI_PAGE_COUNT };       (resource_id_t)
+ *   static const string_t ui_resource_paths[];  for gdt_resource_set_id_table()
+ *   enum { UI_PLAYER, ..., UI_SPRITE_COUNT };
+ *   static const sprite_t ui_sprites[];
+ *
+ * Options:
+ *   -n name     prefix of the generated identifiers and page files (default "atlas")
+ *   -r path     resource directory the pages are placed in (default "/")
+ *   -s size     maximum page width and height, power of two (default 2048)
+ *   -p pixels   padding around every sprite, filled by extruding its edges (default 1)
+ *   -b id       resource_id_t of the first page, when the id table has other entries (default 0)
+ */
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gdt_tga.h"
+
+typedef struct {
+	char* file;
+	char* name;
+	int width;
+	int height;
+	uint8_t* rgba; // top-down rows
+
+	int page;
+	int x; // top-left corner in the page, padding excluded
+	int y;
+} sprite;
+
+typedef struct {
+	int x;
+	int y;
+	int w;
+	int h;
+} rect;
+
+typedef struct {
+	int size;
+	rect* free;
+	int freeCount;
+	int freeCapacity;
+	int usedW; // extent of the placed sprites
+	int usedH;
+} page;
+
+static sprite* sprites;
+static int spriteCount;
+static page* pages;
+static int pageCount;
+
+static const char* name = "atlas";
+static const char* resourceDir = "/";
+static int maxSize = 2048;
+static int padding = 1;
+static int firstId = 0;
+
+
+static void die(const char* format, const char* arg) {
+	fprintf(stderr, "gdt_atlas: ");
+	fprintf(stderr, format, arg);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void* xrealloc(void* p, size_t size) {
+	p = realloc(p, size);
+	if (p == NULL)
+		die("out of memory%s", "");
+	return p;
+}
+
+
+
+// --- TGA ---
+
+static uint8_t* read_tga(const char* file, int* width, int* height) {
+	const char* error;
+	uint8_t* rgba = tga_read(file, width, height, &error);
+	if (rgba == NULL)
+		die(error, file);
+	return rgba;
+}
+
+static void write_tga(const char* file, const uint8_t* rgba, int w, int h) {
+	FILE* f = fopen(file, "wb");
+	if (f == NULL)
+		die("cannot write %s", file);
+
+	uint8_t header[18] = { 0 };
+	header[2] = 2;
+	header[12] = w & 0xff;
+	header[13] = w >> 8;
+	header[14] = h & 0xff;
+	header[15] = h >> 8;
+	header[16] = 32;
+	header[17] = 8; // 8 alpha bits, bottom-up
+	fwrite(header, sizeof(header), 1, f);
+
+	uint8_t* row = xrealloc(NULL, (size_t)w * 4);
+	int x, y;
+	for (y = h - 1; y >= 0; y--) {
+		const uint8_t* in = rgba + (size_t)y * w * 4;
+		for (x = 0; x < w; x++) {
+			row[4 * x + 0] = in[4 * x + 2];
+			row[4 * x + 1] = in[4 * x + 1];
+			row[4 * x + 2] = in[4 * x + 0];
+			row[4 * x + 3] = in[4 * x + 3];
+		}
+		fwrite(row, (size_t)w * 4, 1, f);
+	}
+	free(row);
+
+	if (fclose(f) != 0)
+		die("cannot write %s", file);
+}
+
+
+
+// --- MaxRects ---
+
+static void add_free(page* p, rect r) {
+	if (p->freeCount == p->freeCapacity) {
+		p->freeCapacity = p->freeCapacity ? 2 * p->freeCapacity : 64;
+		p->free = xrealloc(p->free, p->freeCapacity * sizeof(rect));
+	}
+	p->free[p->freeCount++] = r;
+}
+
+static bool contains(rect a, rect b) {
+	return b.x >= a.x && b.y >= a.y && b.x + b.w <= a.x + a.w && b.y + b.h <= a.y + a.h;
+}
+
+static page* new_page(void) {
+	pages = xrealloc(pages, (pageCount + 1) * sizeof(page));
+	page* p = &pages[pageCount++];
+	memset(p, 0, sizeof(page));
+	p->size = maxSize;
+
+	rect all = { 0, 0, maxSize, maxSize };
+	add_free(p, all);
+	return p;
+}
+
+// Best short side fit, ties broken by long side. Returns the index of the free rect or -1
+static int find_position(page* p, int w, int h, int* score) {
+	int best = -1;
+	int bestShort = 0x7fffffff;
+	int bestLong = 0x7fffffff;
+	int i;
+
+	for (i = 0; i < p->freeCount; i++) {
+		rect f = p->free[i];
+		if (f.w < w || f.h < h)
+			continue;
+
+		int dw = f.w - w;
+		int dh = f.h - h;
+		int s = dw < dh ? dw : dh;
+		int l = dw < dh ? dh : dw;
+		if (s < bestShort || (s == bestShort && l < bestLong)) {
+			best = i;
+			bestShort = s;
+			bestLong = l;
+		}
+	}
+
+	*score = bestShort;
+	return best;
+}
+
+static void place(page* p, rect used) {
+	int i;
+	int count = p->freeCount;
+
+	// Split every free rect that intersects the used one into up to four maximal rects
+	for (i = 0; i < count; i++) {
+		rect f = p->free[i];
+		if (used.x >= f.x + f.w || used.x + used.w <= f.x ||
+		    used.y >= f.y + f.h || used.y + used.h <= f.y)
+			continue;
+
+		if (used.x > f.x) {
+			rect r = { f.x, f.y, used.x - f.x, f.h };
+			add_free(p, r);
+		}
+		if (used.x + used.w < f.x + f.w) {
+			rect r = { used.x + used.w, f.y, f.x + f.w - used.x - used.w, f.h };
+			add_free(p, r);
+		}
+		if (used.y > f.y) {
+			rect r = { f.x, f.y, f.w, used.y - f.y };
+			add_free(p, r);
+		}
+		if (used.y + used.h < f.y + f.h) {
+			rect r = { f.x, used.y + used.h, f.w, f.y + f.h - used.y - used.h };
+			add_free(p, r);
+		}
+
+		p->free[i].w = 0; // removed below
+	}
+
+	// Drop the split rects and every rect contained in another one
+	int j, n = 0;
+	for (i = 0; i < p->freeCount; i++) {
+		rect a = p->free[i];
+		if (a.w == 0)
+			continue;
+
+		bool redundant = false;
+		for (j = 0; j < p->freeCount && !redundant; j++) {
+			if (j == i || p->free[j].w == 0)
+				continue;
+			// for identical rects keep the first one
+			redundant = contains(p->free[j], a) && (!contains(a, p->free[j]) || j < i);
+		}
+
+		if (!redundant)
+			p->free[n++] = a;
+	}
+	p->freeCount = n;
+
+	if (used.x + used.w > p->usedW)
+		p->usedW = used.x + used.w;
+	if (used.y + used.h > p->usedH)
+		p->usedH = used.y + used.h;
+}
+
+static int by_size(const void* a, const void* b) {
+	const sprite* s = a;
+	const sprite* t = b;
+	int ms = s->width > s->height ? s->width : s->height;
+	int mt = t->width > t->height ? t->width : t->height;
+	if (ms != mt)
+		return mt - ms;
+	if (s->width * s->height != t->width * t->height)
+		return t->width * t->height - s->width * s->height;
+	return strcmp(s->name, t->name);
+}
+
+static int by_name(const void* a, const void* b) {
+	return strcmp(((const sprite*)a)->name, ((const sprite*)b)->name);
+}
+
+static void pack(void) {
+	int i, j;
+
+	qsort(sprites, spriteCount, sizeof(sprite), by_size);
+
+	for (i = 0; i < spriteCount; i++) {
+		sprite* s = &sprites[i];
+		int w = s->width + 2 * padding;
+		int h = s->height + 2 * padding;
+
+		if (w > maxSize || h > maxSize)
+			die("%s does not fit in a page, try a larger -s", s->file);
+
+		int bestPage = -1;
+		int bestFree = -1;
+		int bestScore = 0x7fffffff;
+		for (j = 0; j < pageCount; j++) {
+			int score;
+			int f = find_position(&pages[j], w, h, &score);
+			if (f != -1 && score < bestScore) {
+				bestPage = j;
+				bestFree = f;
+				bestScore = score;
+			}
+		}
+
+		if (bestPage == -1) {
+			int score;
+			new_page();
+			bestPage = pageCount - 1;
+			bestFree = find_position(&pages[bestPage], w, h, &score);
+		}
+
+		page* p = &pages[bestPage];
+		rect used = { p->free[bestFree].x, p->free[bestFree].y, w, h };
+		place(p, used);
+
+		s->page = bestPage;
+		s->x = used.x + padding;
+		s->y = used.y + padding;
+	}
+
+	// Shrink every page to the smallest power of two that holds its sprites
+	for (j = 0; j < pageCount; j++) {
+		page* p = &pages[j];
+		int used = p->usedW > p->usedH ? p->usedW : p->usedH;
+		int size = 1;
+		while (size < used)
+			size *= 2;
+		p->size = size;
+	}
+}
+
+
+
+// --- Output ---
+
+static void write_pages(const char* outDir) {
+	int i, j, x, y;
+
+	for (j = 0; j < pageCount; j++) {
+		int size = pages[j].size;
+		uint8_t* rgba = calloc((size_t)size * size, 4);
+		if (rgba == NULL)
+			die("out of memory%s", "");
+
+		for (i = 0; i < spriteCount; i++) {
+			sprite* s = &sprites[i];
+			if (s->page != j)
+				continue;
+
+			// Copy the sprite and extrude its edge pixels into the padding
+			for (y = -padding; y < s->height + padding; y++) {
+				int sy = y < 0 ? 0 : y >= s->height ? s->height - 1 : y;
+				for (x = -padding; x < s->width + padding; x++) {
+					int sx = x < 0 ? 0 : x >= s->width ? s->width - 1 : x;
+					memcpy(rgba + 4 * ((size_t)(s->y + y) * size + s->x + x),
+					       s->rgba + 4 * ((size_t)sy * s->width + sx), 4);
+				}
+			}
+		}
+
+		char file[4096];
+		snprintf(file, sizeof(file), "%s/%s_%d.tga", outDir, name, j);
+		write_tga(file, rgba, size, size);
+		printf("%s: %dx%d\n", file, size, size);
+		free(rgba);
+	}
+}
+
+static char* identifier(const char* s) {
+	char* id = strdup(s);
+	char* p;
+	for (p = id; *p; p++)
+		*p = isalnum((unsigned char)*p) ? toupper((unsigned char)*p) : '_';
+	return id;
+}
+
+// Like identifier(), keeping the case, for the lower case names
+static char* lower_identifier(const char* s) {
+	char* id = strdup(s);
+	char* p;
+	for (p = id; *p; p++)
+		if (!isalnum((unsigned char)*p))
+			*p = '_';
+	return id;
+}
+
+static int by_string(const void* a, const void* b) {
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// The PAGE_n, PAGE_COUNT and SPRITE_COUNT identifiers of the header
+static bool reserved(const char* id) {
+	if (strcmp(id, "PAGE_COUNT") == 0 || strcmp(id, "SPRITE_COUNT") == 0)
+		return true;
+	if (strncmp(id, "PAGE_", 5) != 0 || id[5] == '\0')
+		return false;
+	for (id += 5; *id; id++)
+		if (!isdigit((unsigned char)*id))
+			return false;
+	return true;
+}
+
+// Fails on names that would not give a header that compiles
+static void check_names(void) {
+	if (name[0] == '\0' || isdigit((unsigned char)name[0]))
+		die("-n %s does not start an identifier", name);
+
+	char** ids = xrealloc(NULL, spriteCount * sizeof(char*));
+	int i;
+	for (i = 0; i < spriteCount; i++) {
+		ids[i] = identifier(sprites[i].name);
+		if (reserved(ids[i]))
+			die("the sprite name %s is taken by the header", sprites[i].name);
+	}
+
+	// Sorted again, names that differ only in punctuation or case may not be adjacent
+	qsort(ids, spriteCount, sizeof(char*), by_string);
+	for (i = 1; i < spriteCount; i++)
+		if (strcmp(ids[i - 1], ids[i]) == 0)
+			die("two sprites would be named %s", ids[i]);
+
+	for (i = 0; i < spriteCount; i++)
+		free(ids[i]);
+	free(ids);
+}
+
+static void write_header(const char* headerFile) {
+	FILE* f = fopen(headerFile, "w");
+	if (f == NULL)
+		die("cannot write %s", headerFile);
+
+	char* prefix = identifier(name);
+	char* lower = lower_identifier(name);
+	const char* slash = resourceDir[strlen(resourceDir) - 1] == '/' ? "" : "/";
+	int i, j;
+
+	fprintf(f, "/* Generated by gdt_atlas, do not edit. */\n\n");
+	fprintf(f, "#ifndef %s_atlas_h\n#define %s_atlas_h\n\n", lower, lower);
+	fprintf(f, "#include <gdt/gdt.h>\n\n");
+
+	fprintf(f, "// Atlas pages, for gdt_resource_load_id()\n");
+	fprintf(f, "enum {\n");
+	for (j = 0; j < pageCount; j++)
+		fprintf(f, "\t%s_PAGE_%d = %d,\n", prefix, j, firstId + j);
+	fprintf(f, "\t%s_PAGE_COUNT = %d\n};\n\n", prefix, pageCount);
+
+	if (firstId)
+		fprintf(f, "// Register with gdt_resource_set_id_table(), starting at index %d\n", firstId);
+	else
+		fprintf(f, "// Register with gdt_resource_set_id_table()\n");
+	fprintf(f, "static const string_t %s_resource_paths[%s_PAGE_COUNT] = {\n", lower, prefix);
+	for (j = 0; j < pageCount; j++)
+		fprintf(f, "\t\"%s%s%s_%d.tga\",\n", resourceDir, slash, name, j);
+	fprintf(f, "};\n\n");
+
+	fprintf(f, "enum {\n");
+	for (i = 0; i < spriteCount; i++) {
+		char* id = identifier(sprites[i].name);
+		fprintf(f, "\t%s_%s,\n", prefix, id);
+		free(id);
+	}
+	fprintf(f, "\t%s_SPRITE_COUNT\n};\n\n", prefix);
+
+	fprintf(f, "static const sprite_t %s_sprites[%s_SPRITE_COUNT] = {\n", lower, prefix);
+	for (i = 0; i < spriteCount; i++) {
+		sprite* s = &sprites[i];
+		float size = pages[s->page].size;
+
+		// v is flipped since the page rows are stored, and uploaded, bottom-up
+		fprintf(f, "\t{ %d, %d, %d, %d, %d, %.9gf, %.9gf, %.9gf, %.9gf }, // %s\n",
+		        firstId + s->page, s->x, s->y, s->width, s->height,
+		        s->x / size, (size - s->y - s->height) / size,
+		        (s->x + s->width) / size, (size - s->y) / size,
+		        s->file);
+	}
+	fprintf(f, "};\n\n#endif // %s_atlas_h\n", lower);
+
+	free(prefix);
+	free(lower);
+	if (fclose(f) != 0)
+		die("cannot write %s", headerFile);
+}
+
+
+
+static char* sprite_name(const char* file) {
+	const char* base = strrchr(file, '/');
+	base = base ? base + 1 : file;
+
+	char* s = strdup(base);
+	char* dot = strrchr(s, '.');
+	if (dot && dot != s)
+		*dot = '\0';
+	return s;
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: gdt_atlas [-n name] [-r resourceDir] [-s maxSize] [-p padding] [-b firstId]\n"
+	                "                 outDir header.h sprite.tga...\n");
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	int i = 1;
+
+	for (; i < argc && argv[i][0] == '-'; i += 2) {
+		if (i + 1 >= argc)
+			usage();
+
+		char* v = argv[i + 1];
+		switch (argv[i][1]) {
+			case 'n': name = v; break;
+			case 'r': resourceDir = v; break;
+			case 's': maxSize = atoi(v); break;
+			case 'p': padding = atoi(v); break;
+			case 'b': firstId = atoi(v); break;
+			default: usage();
+		}
+	}
+
+	if (argc - i < 3 || maxSize <= 0 || (maxSize & (maxSize - 1)) || padding < 0)
+		usage();
+
+	const char* outDir = argv[i];
+	const char* header = argv[i + 1];
+	i += 2;
+
+	spriteCount = argc - i;
+	sprites = xrealloc(NULL, spriteCount * sizeof(sprite));
+
+	int j;
+	for (j = 0; j < spriteCount; j++) {
+		sprite* s = &sprites[j];
+		s->file = argv[i + j];
+		s->name = sprite_name(s->file);
+		s->rgba = read_tga(s->file, &s->width, &s->height);
+	}
+
+	// Sprite IDs follow the names so they stay stable when sprites change size
+	qsort(sprites, spriteCount, sizeof(sprite), by_name);
+	check_names();
+
+	pack();
+	qsort(sprites, spriteCount, sizeof(sprite), by_name);
+
+	write_pages(outDir);
+	write_header(header);
+	return 0;
+}
@@ -0,0 +1,729 @@
+/*
+ * gdt_meshconv.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* gdt_meshconv -- Offline mesh converter, run on the build host.
+ *
+ * Converts a Wavefront OBJ file into the binary format of gdt_mesh.h:
+ *
+ *   cc -O2 -Iinclude -o gdt_meshconv tools/gdt_meshconv.c -lm
+ *   gdt_meshconv model.obj assets/model.mesh
+ *
+ * On the way the mesh is
+ *   - indexed, sharing identical position/texcoord/normal combinations
+ *   - reordered for the post-transform vertex cache (Tipsify)
+ *   - reordered for less overdraw, by sorting the Tipsify clusters
+ *     so that outward facing ones come first
+ *   - reordered for vertex fetch, vertices in order of first use
+ *   - quantized: positions to normalized shorts within the bounds,
+ *     normals to normalized bytes, texcoords to normalized shorts
+ *
+ * Options:
+ *   -c size   vertex cache size to optimize for (default 16)
+ *   -h        half floats for positions and texcoords (needs OES_vertex_half_float)
+ *   -f        no quantization, everything as floats
+ */
+
+#define GDT_MESH_FORMAT_ONLY
+#include <gdt/gdt_mesh.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GL_TRIANGLES 0x0004
+#define GL_BYTE 0x1400
+#define GL_SHORT 0x1402
+#define GL_UNSIGNED_SHORT 0x1403
+#define GL_FLOAT 0x1406
+#define GL_HALF_FLOAT_OES 0x8D61
+
+typedef struct {
+	float p[3];
+	float t[2];
+	float n[3];
+} vertex;
+
+typedef struct {
+	int first; // triangle
+	int count;
+	float key;
+} cluster;
+
+static vertex* vertices;
+static int vertexCount;
+static int* indices;
+static int indexCount;
+static bool hasTexcoords = false;
+static bool hasNormals = false;
+
+static int cacheSize = 16;
+static enum { QUANTIZE_INT, QUANTIZE_HALF, QUANTIZE_NONE } quantize = QUANTIZE_INT;
+
+
+static void die(const char* format, const char* arg) {
+	fprintf(stderr, "gdt_meshconv: ");
+	fprintf(stderr, format, arg);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void* xrealloc(void* p, size_t size) {
+	p = realloc(p, size);
+	if (p == NULL && size)
+		die("out of memory%s", "");
+	return p;
+}
+
+#define PUSH(array, count, capacity, value) do { \
+	if ((count) == (capacity)) { \
+		(capacity) = (capacity) ? 2 * (capacity) : 1024; \
+		(array) = xrealloc((array), (capacity) * sizeof(*(array))); \
+	} \
+	(array)[(count)++] = (value); \
+} while (0)
+
+
+
+// --- OBJ ---
+
+typedef struct {
+	int v;
+	int t;
+	int n;
+	int index; // in vertices, -1 if the slot is empty
+} corner;
+
+static corner* table;
+static int tableSize;
+
+static int vertex_index(int v, int t, int n, float (*pos)[3], float (*tex)[2], float (*nrm)[3], int* capacity) {
+	unsigned h = ((unsigned)v * 73856093u) ^ ((unsigned)t * 19349663u) ^ ((unsigned)n * 83492791u);
+	int i = h & (tableSize - 1);
+
+	while (table[i].index != -1) {
+		if (table[i].v == v && table[i].t == t && table[i].n == n)
+			return table[i].index;
+		i = (i + 1) & (tableSize - 1);
+	}
+
+	vertex x;
+	memset(&x, 0, sizeof(x));
+	memcpy(x.p, pos[v], sizeof(x.p));
+	if (t >= 0)
+		memcpy(x.t, tex[t], sizeof(x.t));
+	if (n >= 0)
+		memcpy(x.n, nrm[n], sizeof(x.n));
+	PUSH(vertices, vertexCount, *capacity, x);
+
+	table[i].v = v;
+	table[i].t = t;
+	table[i].n = n;
+	table[i].index = vertexCount - 1;
+
+	// Keep the table at most half full
+	if (2 * vertexCount >= tableSize)
+		die("too many vertices%s", "");
+	return vertexCount - 1;
+}
+
+static int resolve(int i, int count) {
+	// OBJ indices are 1-based, negative ones count from the end
+	return i < 0 ? count + i : i - 1;
+}
+
+static void read_obj(const char* file) {
+	FILE* f = fopen(file, "r");
+	if (f == NULL)
+		die("cannot open %s", file);
+
+	float (*pos)[3] = NULL;
+	float (*tex)[2] = NULL;
+	float (*nrm)[3] = NULL;
+	int posCount = 0, texCount = 0, nrmCount = 0;
+	int posCap = 0, texCap = 0, nrmCap = 0;
+	int vertexCap = 0, indexCap = 0;
+
+	tableSize = 1 << 18;
+	table = xrealloc(NULL, tableSize * sizeof(corner));
+	memset(table, 0xff, tableSize * sizeof(corner));
+
+	char line[4096];
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == 'v' && line[1] == ' ') {
+			float p[3] = { 0, 0, 0 };
+			sscanf(line + 2, "%f %f %f", &p[0], &p[1], &p[2]);
+			if (posCount == posCap) {
+				posCap = posCap ? 2 * posCap : 1024;
+				pos = xrealloc(pos, posCap * sizeof(*pos));
+			}
+			memcpy(pos[posCount++], p, sizeof(p));
+		} else if (line[0] == 'v' && line[1] == 't') {
+			float t[2] = { 0, 0 };
+			sscanf(line + 3, "%f %f", &t[0], &t[1]);
+			if (texCount == texCap) {
+				texCap = texCap ? 2 * texCap : 1024;
+				tex = xrealloc(tex, texCap * sizeof(*tex));
+			}
+			memcpy(tex[texCount++], t, sizeof(t));
+		} else if (line[0] == 'v' && line[1] == 'n') {
+			float n[3] = { 0, 0, 0 };
+			sscanf(line + 3, "%f %f %f", &n[0], &n[1], &n[2]);
+			if (nrmCount == nrmCap) {
+				nrmCap = nrmCap ? 2 * nrmCap : 1024;
+				nrm = xrealloc(nrm, nrmCap * sizeof(*nrm));
+			}
+			memcpy(nrm[nrmCount++], n, sizeof(n));
+		} else if (line[0] == 'f' && line[1] == ' ') {
+			int face[64];
+			int corners = 0;
+			char* s = strtok(line + 2, " \t\r\n");
+
+			for (; s && corners < 64; s = strtok(NULL, " \t\r\n")) {
+				int v = 0, t = 0, n = 0;
+				if (sscanf(s, "%d/%d/%d", &v, &t, &n) != 3 &&
+				    sscanf(s, "%d//%d", &v, &n) != 2 &&
+				    sscanf(s, "%d/%d", &v, &t) != 2 &&
+				    sscanf(s, "%d", &v) != 1)
+					die("bad face: %s", s);
+
+				v = resolve(v, posCount);
+				t = t ? resolve(t, texCount) : -1;
+				n = n ? resolve(n, nrmCount) : -1;
+				if (v < 0 || v >= posCount || t >= texCount || n >= nrmCount)
+					die("index out of range: %s", s);
+
+				hasTexcoords |= t >= 0;
+				hasNormals |= n >= 0;
+				face[corners++] = vertex_index(v, t, n, pos, tex, nrm, &vertexCap);
+			}
+
+			// Polygons are triangulated as fans
+			int i;
+			for (i = 2; i < corners; i++) {
+				PUSH(indices, indexCount, indexCap, face[0]);
+				PUSH(indices, indexCount, indexCap, face[i - 1]);
+				PUSH(indices, indexCount, indexCap, face[i]);
+			}
+		}
+	}
+
+	fclose(f);
+	free(pos);
+	free(tex);
+	free(nrm);
+	free(table);
+
+	if (indexCount == 0)
+		die("%s has no faces", file);
+	if (vertexCount > 65535)
+		die("more than 65535 vertices, split the mesh%s", "");
+}
+
+
+
+// --- Vertex cache ---
+
+static float acmr(const int* idx, int count) {
+	int* cache = xrealloc(NULL, cacheSize * sizeof(int));
+	int head = 0, misses = 0, i, j;
+
+	for (i = 0; i < cacheSize; i++)
+		cache[i] = -1;
+
+	// FIFO, like most mobile GPUs
+	for (i = 0; i < count; i++) {
+		bool hit = false;
+		for (j = 0; j < cacheSize && !hit; j++)
+			hit = cache[j] == idx[i];
+		if (!hit) {
+			cache[head] = idx[i];
+			head = (head + 1) % cacheSize;
+			misses++;
+		}
+	}
+
+	free(cache);
+	return misses / (count / 3.0f);
+}
+
+/* Tipsify, from Sander, Nehab and Barczak, "Fast Triangle Reordering for
+ * Vertex Locality and Reduced Overdraw" (2007). Writes the new order to out
+ * and the triangle positions where it had to jump to a new area (the
+ * natural cluster boundaries) to boundaries.
+ */
+static void tipsify(int* out, bool* boundaries) {
+	int triCount = indexCount / 3;
+	int* offsets = xrealloc(NULL, (vertexCount + 1) * sizeof(int));
+	int* adjacency = xrealloc(NULL, indexCount * sizeof(int));
+	int* live = calloc(vertexCount, sizeof(int));
+	int* stamp = calloc(vertexCount, sizeof(int));
+	bool* emitted = calloc(triCount, sizeof(bool));
+	int* deadEnd = xrealloc(NULL, indexCount * sizeof(int));
+	int* candidates = xrealloc(NULL, indexCount * sizeof(int));
+	int deadEndCount = 0;
+	int i, j;
+
+	if (live == NULL || stamp == NULL || emitted == NULL)
+		die("out of memory%s", "");
+
+	for (i = 0; i < indexCount; i++)
+		live[indices[i]]++;
+
+	offsets[0] = 0;
+	for (i = 0; i < vertexCount; i++)
+		offsets[i + 1] = offsets[i] + live[i];
+
+	int* fill = calloc(vertexCount, sizeof(int));
+	for (i = 0; i < indexCount; i++) {
+		int v = indices[i];
+		adjacency[offsets[v] + fill[v]++] = i / 3;
+	}
+	free(fill);
+
+	int time = cacheSize + 1;
+	int cursor = 0;
+	int fan = 0;
+	int outCount = 0;
+
+	memset(boundaries, 0, triCount * sizeof(bool));
+	boundaries[0] = true;
+
+	while (fan >= 0) {
+		int candidateCount = 0;
+
+		for (i = offsets[fan]; i < offsets[fan + 1]; i++) {
+			int t = adjacency[i];
+			if (emitted[t])
+				continue;
+
+			for (j = 0; j < 3; j++) {
+				int v = indices[3 * t + j];
+				out[outCount++] = v;
+				deadEnd[deadEndCount++] = v;
+				candidates[candidateCount++] = v;
+				live[v]--;
+				if (time - stamp[v] > cacheSize)
+					stamp[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// The candidate still in the cache with the most remaining triangles
+		int next = -1;
+		int best = -1;
+		for (i = 0; i < candidateCount; i++) {
+			int v = candidates[i];
+			if (live[v] <= 0)
+				continue;
+
+			int priority = 0;
+			if (time - stamp[v] + 2 * live[v] <= cacheSize)
+				priority = time - stamp[v];
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+
+		if (next == -1) {
+			while (deadEndCount > 0 && next == -1) {
+				int v = deadEnd[--deadEndCount];
+				if (live[v] > 0)
+					next = v;
+			}
+			while (next == -1 && cursor < vertexCount) {
+				if (live[cursor] > 0)
+					next = cursor;
+				cursor++;
+			}
+
+			if (next != -1 && outCount / 3 < triCount)
+				boundaries[outCount / 3] = true;
+		}
+
+		fan = next;
+	}
+
+	free(offsets);
+	free(adjacency);
+	free(live);
+	free(stamp);
+	free(emitted);
+	free(deadEnd);
+	free(candidates);
+}
+
+
+
+// --- Overdraw ---
+
+static int by_key(const void* a, const void* b) {
+	const cluster* x = a;
+	const cluster* y = b;
+	if (x->key != y->key)
+		return x->key < y->key ? 1 : -1;
+	return x->first - y->first;
+}
+
+/* Clusters that face away from the center of the mesh are drawn first,
+ * as they are the most likely to occlude the rest. Small clusters are
+ * merged so that the cache locality won by Tipsify is kept.
+ */
+static void reorder_for_overdraw(int* idx, const bool* boundaries) {
+	int triCount = indexCount / 3;
+	cluster* clusters = NULL;
+	int clusterCount = 0, clusterCap = 0;
+	int minSize = cacheSize * 2;
+	int i, j;
+
+	for (i = 0; i < triCount; i++) {
+		if (boundaries[i] && (clusterCount == 0 || clusters[clusterCount - 1].count >= minSize)) {
+			cluster c = { i, 0, 0 };
+			PUSH(clusters, clusterCount, clusterCap, c);
+		}
+		clusters[clusterCount - 1].count++;
+	}
+
+	float center[3] = { 0, 0, 0 };
+	for (i = 0; i < vertexCount; i++)
+		for (j = 0; j < 3; j++)
+			center[j] += vertices[i].p[j] / vertexCount;
+
+	for (i = 0; i < clusterCount; i++) {
+		cluster* c = &clusters[i];
+		double centroid[3] = { 0, 0, 0 };
+		double normal[3] = { 0, 0, 0 };
+		double area = 0;
+		int t;
+
+		for (t = c->first; t < c->first + c->count; t++) {
+			const float* a = vertices[idx[3 * t]].p;
+			const float* b = vertices[idx[3 * t + 1]].p;
+			const float* d = vertices[idx[3 * t + 2]].p;
+			double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			double e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+			double n[3] = {
+				e1[1] * e2[2] - e1[2] * e2[1],
+				e1[2] * e2[0] - e1[0] * e2[2],
+				e1[0] * e2[1] - e1[1] * e2[0]
+			};
+			double w = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]); // twice the area
+
+			for (j = 0; j < 3; j++) {
+				centroid[j] += w * (a[j] + b[j] + d[j]) / 3;
+				normal[j] += n[j];
+			}
+			area += w;
+		}
+
+		double len = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		c->key = 0;
+		if (area > 0 && len > 0)
+			for (j = 0; j < 3; j++)
+				c->key += (centroid[j] / area - center[j]) * normal[j] / len;
+	}
+
+	qsort(clusters, clusterCount, sizeof(cluster), by_key);
+
+	int* sorted = xrealloc(NULL, indexCount * sizeof(int));
+	int n = 0;
+	for (i = 0; i < clusterCount; i++) {
+		memcpy(sorted + n, idx + 3 * clusters[i].first, 3 * clusters[i].count * sizeof(int));
+		n += 3 * clusters[i].count;
+	}
+	memcpy(idx, sorted, indexCount * sizeof(int));
+
+	printf("overdraw: %d clusters\n", clusterCount);
+	free(sorted);
+	free(clusters);
+}
+
+
+
+// --- Vertex fetch ---
+
+static void reorder_vertices(void) {
+	int* remap = xrealloc(NULL, vertexCount * sizeof(int));
+	vertex* reordered = xrealloc(NULL, vertexCount * sizeof(vertex));
+	int next = 0, i;
+
+	for (i = 0; i < vertexCount; i++)
+		remap[i] = -1;
+
+	for (i = 0; i < indexCount; i++) {
+		int v = indices[i];
+		if (remap[v] == -1) {
+			remap[v] = next;
+			reordered[next++] = vertices[v];
+		}
+		indices[i] = remap[v];
+	}
+
+	free(vertices);
+	free(remap);
+	vertices = reordered;
+	vertexCount = next; // unreferenced vertices are dropped
+}
+
+
+
+// --- Output ---
+
+static uint16_t to_half(float f) {
+	union { float f; uint32_t u; } x = { f };
+	uint32_t sign = (x.u >> 16) & 0x8000;
+	int32_t e = (int32_t)((x.u >> 23) & 0xff) - 127 + 15;
+	uint32_t m = x.u & 0x7fffff;
+
+	if (((x.u >> 23) & 0xff) == 0xff)
+		return sign | 0x7c00 | (m ? 0x200 : 0);
+	if (e >= 31)
+		return sign | 0x7c00;
+	if (e <= 0) {
+		if (e < -10)
+			return sign;
+		// subnormal
+		m |= 0x800000;
+		int shift = 14 - e;
+		return sign | (uint16_t)((m + (1u << (shift - 1))) >> shift);
+	}
+
+	uint32_t h = sign | (e << 10) | (m >> 13);
+	uint32_t rest = m & 0x1fff;
+	if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+		h++; // round to nearest even, may carry into the exponent
+	return (uint16_t)h;
+}
+
+// OpenGL ES 2.0 maps a signed normalized value c of b bits to (2c + 1) / (2^b - 1)
+static int32_t snorm(float f, int bits) {
+	float max = (float)((1 << bits) - 1);
+	float c = floorf((f * max - 1) / 2 + 0.5f);
+	float lim = (float)((1 << (bits - 1)) - 1);
+	return (int32_t)(c > lim ? lim : c < -lim - 1 ? -lim - 1 : c);
+}
+
+static mesh_attribute_t* add_attribute(mesh_header_t* h, mesh_semantic_t semantic, int size, uint32_t type, bool normalized) {
+	mesh_attribute_t* a = &h->attributes[h->attribute_count++];
+	int i;
+
+	a->semantic = semantic;
+	a->size = size;
+	a->type = type;
+	a->normalized = normalized;
+	a->offset = h->vertex_stride;
+	for (i = 0; i < 4; i++) {
+		a->scale[i] = 1;
+		a->bias[i] = 0;
+	}
+
+	int bytes = size * (type == GL_FLOAT ? 4 : type == GL_BYTE ? 1 : 2);
+	h->vertex_stride += (bytes + 3) & ~3; // keep every attribute 4 byte aligned
+	return a;
+}
+
+// Store n floats at dst as described by a, quantizing within scale and bias
+static void store(uint8_t* dst, const mesh_attribute_t* a, const float* v, int n) {
+	int i;
+	for (i = 0; i < n; i++) {
+		float q = (v[i] - a->bias[i]) / a->scale[i];
+		switch (a->type) {
+			case GL_FLOAT:
+				memcpy(dst + 4 * i, &v[i], 4);
+				break;
+			case GL_HALF_FLOAT_OES: {
+				uint16_t h = to_half(v[i]);
+				memcpy(dst + 2 * i, &h, 2);
+				break;
+			}
+			case GL_SHORT: {
+				int16_t s = (int16_t)snorm(q, 16);
+				memcpy(dst + 2 * i, &s, 2);
+				break;
+			}
+			case GL_UNSIGNED_SHORT: {
+				float c = floorf(q * 65535 + 0.5f);
+				uint16_t s = (uint16_t)(c < 0 ? 0 : c > 65535 ? 65535 : c);
+				memcpy(dst + 2 * i, &s, 2);
+				break;
+			}
+			case GL_BYTE:
+				dst[i] = (uint8_t)(int8_t)snorm(q, 8);
+				break;
+		}
+	}
+}
+
+static void fit(mesh_attribute_t* a, const float* min, const float* max, int n) {
+	int i;
+	for (i = 0; i < n; i++) {
+		a->bias[i] = (max[i] + min[i]) / 2;
+		a->scale[i] = (max[i] - min[i]) / 2;
+		if (a->scale[i] == 0)
+			a->scale[i] = 1;
+	}
+}
+
+static void write_mesh(const char* file) {
+	mesh_header_t h;
+	float tmin[2] = { 1e30f, 1e30f }, tmax[2] = { -1e30f, -1e30f };
+	int i, j;
+
+	memset(&h, 0, sizeof(h));
+	h.magic = GDT_MESH_MAGIC;
+	h.version = GDT_MESH_VERSION;
+	h.primitive = GL_TRIANGLES;
+	h.index_type = GL_UNSIGNED_SHORT;
+	h.vertex_count = vertexCount;
+	h.index_count = indexCount;
+
+	for (j = 0; j < 3; j++) {
+		h.bounds_min[j] = 1e30f;
+		h.bounds_max[j] = -1e30f;
+	}
+	for (i = 0; i < vertexCount; i++) {
+		for (j = 0; j < 3; j++) {
+			if (vertices[i].p[j] < h.bounds_min[j]) h.bounds_min[j] = vertices[i].p[j];
+			if (vertices[i].p[j] > h.bounds_max[j]) h.bounds_max[j] = vertices[i].p[j];
+		}
+		for (j = 0; j < 2; j++) {
+			if (vertices[i].t[j] < tmin[j]) tmin[j] = vertices[i].t[j];
+			if (vertices[i].t[j] > tmax[j]) tmax[j] = vertices[i].t[j];
+		}
+	}
+
+	mesh_attribute_t* p;
+	mesh_attribute_t* n = NULL;
+	mesh_attribute_t* t = NULL;
+
+	switch (quantize) {
+		case QUANTIZE_INT:
+			p = add_attribute(&h, MESH_POSITION, 3, GL_SHORT, true);
+			fit(p, h.bounds_min, h.bounds_max, 3);
+			if (hasNormals)
+				n = add_attribute(&h, MESH_NORMAL, 3, GL_BYTE, true);
+			if (hasTexcoords) {
+				bool unit = tmin[0] >= 0 && tmin[1] >= 0 && tmax[0] <= 1 && tmax[1] <= 1;
+				t = add_attribute(&h, MESH_TEXCOORD, 2, unit ? GL_UNSIGNED_SHORT : GL_SHORT, true);
+				if (!unit)
+					fit(t, tmin, tmax, 2);
+			}
+			break;
+		case QUANTIZE_HALF:
+			p = add_attribute(&h, MESH_POSITION, 3, GL_HALF_FLOAT_OES, false);
+			if (hasNormals)
+				n = add_attribute(&h, MESH_NORMAL, 3, GL_BYTE, true);
+			if (hasTexcoords)
+				t = add_attribute(&h, MESH_TEXCOORD, 2, GL_HALF_FLOAT_OES, false);
+			break;
+		default:
+			p = add_attribute(&h, MESH_POSITION, 3, GL_FLOAT, false);
+			if (hasNormals)
+				n = add_attribute(&h, MESH_NORMAL, 3, GL_FLOAT, false);
+			if (hasTexcoords)
+				t = add_attribute(&h, MESH_TEXCOORD, 2, GL_FLOAT, false);
+	}
+
+	h.vertex_offset = (sizeof(h) + 15) & ~15;
+	h.index_offset = (h.vertex_offset + vertexCount * h.vertex_stride + 3) & ~3;
+
+	size_t size = h.index_offset + indexCount * sizeof(uint16_t);
+	uint8_t* out = calloc(size, 1);
+	if (out == NULL)
+		die("out of memory%s", "");
+
+	memcpy(out, &h, sizeof(h));
+	for (i = 0; i < vertexCount; i++) {
+		uint8_t* v = out + h.vertex_offset + i * h.vertex_stride;
+		store(v + p->offset, p, vertices[i].p, 3);
+		if (n) {
+			float len = sqrtf(vertices[i].n[0] * vertices[i].n[0] + vertices[i].n[1] * vertices[i].n[1] + vertices[i].n[2] * vertices[i].n[2]);
+			float unit[3] = { 0, 0, 0 };
+			if (len > 0)
+				for (j = 0; j < 3; j++)
+					unit[j] = vertices[i].n[j] / len;
+			store(v + n->offset, n, unit, 3);
+		}
+		if (t)
+			store(v + t->offset, t, vertices[i].t, 2);
+	}
+	for (i = 0; i < indexCount; i++) {
+		uint16_t x = (uint16_t)indices[i];
+		memcpy(out + h.index_offset + 2 * i, &x, 2);
+	}
+
+	FILE* f = fopen(file, "wb");
+	if (f == NULL || fwrite(out, size, 1, f) != 1 || fclose(f) != 0)
+		die("cannot write %s", file);
+
+	printf("%s: %d vertices (%d bytes each), %d triangles, %lu bytes\n",
+	       file, vertexCount, h.vertex_stride, indexCount / 3, (unsigned long)size);
+	free(out);
+}
+
+
+
+static void usage(void) {
+	fprintf(stderr, "usage: gdt_meshconv [-c cacheSize] [-h | -f] input.obj output.mesh\n");
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	int i = 1;
+
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		switch (argv[i][1]) {
+			case 'c':
+				if (++i >= argc)
+					usage();
+				cacheSize = atoi(argv[i]);
+				break;
+			case 'h': quantize = QUANTIZE_HALF; break;
+			case 'f': quantize = QUANTIZE_NONE; break;
+			default: usage();
+		}
+	}
+
+	if (argc - i != 2 || cacheSize < 3)
+		usage();
+
+	read_obj(argv[i]);
+	printf("ACMR before: %.3f\n", acmr(indices, indexCount));
+
+	int* optimized = xrealloc(NULL, indexCount * sizeof(int));
+	bool* boundaries = xrealloc(NULL, indexCount / 3 * sizeof(bool));
+	tipsify(optimized, boundaries);
+	printf("ACMR tipsify: %.3f\n", acmr(optimized, indexCount));
+
+	reorder_for_overdraw(optimized, boundaries);
+	printf("ACMR final: %.3f\n", acmr(optimized, indexCount));
+
+	free(indices);
+	free(boundaries);
+	indices = optimized;
+
+	reorder_vertices();
+	write_mesh(argv[i + 1]);
+	return 0;
+}
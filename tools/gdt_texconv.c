@@ -0,0 +1,283 @@
+/*
+ * gdt_texconv.c
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* gdt_texconv -- Offline texture converter, run on the build host.
+ *
+ * Converts a TGA image, power of two sized, into the mip chain format of
+ * gdt_texture.h, for streaming with gdt_texture_open():
+ *
+ *   cc -O2 -Iinclude -o gdt_texconv tools/gdt_texconv.c -lm
+ *   gdt_texconv -f rgb565 grass.tga assets/grass.gdtt
+ *
+ * The levels are made with a box filter in linear light, so that they do
+ * not get darker as they get smaller, and are stored smallest first so
+ * that only the levels a game needs are ever read.
+ *
+ * Options:
+ *   -f format   rgba8888, rgb888, rgb565, rgba4444 or l8 (default rgba8888
+ *               if any pixel is translucent, rgb888 if not)
+ */
+
+#define GDT_TEXTURE_FORMAT_ONLY
+#include <gdt/gdt_texture.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gdt_tga.h"
+
+#define GL_UNSIGNED_BYTE 0x1401
+#define GL_RGB 0x1907
+#define GL_RGBA 0x1908
+#define GL_LUMINANCE 0x1909
+#define GL_UNSIGNED_SHORT_4_4_4_4 0x8033
+#define GL_UNSIGNED_SHORT_5_6_5 0x8363
+
+typedef struct {
+	const char* name;
+	uint32_t format;
+	uint32_t type;
+	int bytes; // per pixel
+} format;
+
+static const format formats[] = {
+	{ "rgba8888", GL_RGBA,      GL_UNSIGNED_BYTE,          4 },
+	{ "rgb888",   GL_RGB,       GL_UNSIGNED_BYTE,          3 },
+	{ "rgb565",   GL_RGB,       GL_UNSIGNED_SHORT_5_6_5,   2 },
+	{ "rgba4444", GL_RGBA,      GL_UNSIGNED_SHORT_4_4_4_4, 2 },
+	{ "l8",       GL_LUMINANCE, GL_UNSIGNED_BYTE,          1 },
+};
+
+typedef struct {
+	int width;
+	int height;
+	float* rgba; // linear light, top-down rows
+} level;
+
+
+static void die(const char* format, const char* arg) {
+	fprintf(stderr, "gdt_texconv: ");
+	fprintf(stderr, format, arg);
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+static void* xrealloc(void* p, size_t size) {
+	p = realloc(p, size);
+	if (p == NULL)
+		die("out of memory%s", "");
+	return p;
+}
+
+
+
+// --- TGA ---
+
+static uint8_t* read_tga(const char* file, int* width, int* height) {
+	const char* error;
+	uint8_t* rgba = tga_read(file, width, height, &error);
+	if (rgba == NULL)
+		die(error, file);
+	return rgba;
+}
+
+
+
+// --- Mip levels ---
+
+static float to_linear(float c) {
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float to_srgb(float c) {
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1 / 2.4f) - 0.055f;
+}
+
+// Every pixel 2x2 of the level above, odd edges clamped so nothing is dropped
+static level downsample(const level* src) {
+	level dst;
+	dst.width = src->width > 1 ? src->width / 2 : 1;
+	dst.height = src->height > 1 ? src->height / 2 : 1;
+	dst.rgba = xrealloc(NULL, (size_t)dst.width * dst.height * 4 * sizeof(float));
+
+	int x, y, c;
+	for (y = 0; y < dst.height; y++) {
+		int y0 = 2 * y < src->height ? 2 * y : src->height - 1;
+		int y1 = 2 * y + 1 < src->height ? 2 * y + 1 : src->height - 1;
+		for (x = 0; x < dst.width; x++) {
+			int x0 = 2 * x < src->width ? 2 * x : src->width - 1;
+			int x1 = 2 * x + 1 < src->width ? 2 * x + 1 : src->width - 1;
+			for (c = 0; c < 4; c++)
+				dst.rgba[4 * (y * dst.width + x) + c] = 0.25f *
+				    (src->rgba[4 * (y0 * src->width + x0) + c] + src->rgba[4 * (y0 * src->width + x1) + c] +
+				     src->rgba[4 * (y1 * src->width + x0) + c] + src->rgba[4 * (y1 * src->width + x1) + c]);
+		}
+	}
+	return dst;
+}
+
+static int quantize(float c, int max) {
+	int v = (int)(c * max + 0.5f);
+	return v < 0 ? 0 : v > max ? max : v;
+}
+
+// Pack a level as GL wants it, rows bottom first
+static void encode(const level* l, const format* fmt, uint8_t* out) {
+	int x, y;
+	for (y = 0; y < l->height; y++) {
+		const float* row = l->rgba + 4 * (size_t)(l->height - 1 - y) * l->width;
+		for (x = 0; x < l->width; x++, out += fmt->bytes) {
+			const float* p = row + 4 * x;
+			float r = to_srgb(p[0]), g = to_srgb(p[1]), b = to_srgb(p[2]);
+			uint16_t v;
+
+			switch (fmt->type) {
+				case GL_UNSIGNED_SHORT_5_6_5:
+					v = quantize(r, 31) << 11 | quantize(g, 63) << 5 | quantize(b, 31);
+					memcpy(out, &v, 2);
+					break;
+				case GL_UNSIGNED_SHORT_4_4_4_4:
+					v = quantize(r, 15) << 12 | quantize(g, 15) << 8 | quantize(b, 15) << 4 | quantize(p[3], 15);
+					memcpy(out, &v, 2);
+					break;
+				default:
+					if (fmt->format == GL_LUMINANCE) {
+						out[0] = (77 * quantize(r, 255) + 150 * quantize(g, 255) + 29 * quantize(b, 255)) >> 8;
+					} else {
+						out[0] = quantize(r, 255);
+						out[1] = quantize(g, 255);
+						out[2] = quantize(b, 255);
+						if (fmt->bytes == 4)
+							out[3] = quantize(p[3], 255);
+					}
+			}
+		}
+	}
+}
+
+static void write_texture(const char* file, level* levels, int count, const format* fmt) {
+	texture_header_t h;
+	int i;
+
+	memset(&h, 0, sizeof(h));
+	h.magic = GDT_TEXTURE_MAGIC;
+	h.version = GDT_TEXTURE_VERSION;
+	h.format = fmt->format;
+	h.type = fmt->type;
+	h.width = levels[0].width;
+	h.height = levels[0].height;
+	h.level_count = count;
+
+	// Smallest first
+	size_t size = sizeof(h);
+	for (i = count - 1; i >= 0; i--) {
+		size = (size + 15) & ~(size_t)15;
+		h.levels[i].offset = (uint32_t)size;
+		h.levels[i].size = (uint32_t)levels[i].width * levels[i].height * fmt->bytes;
+		size += h.levels[i].size;
+	}
+	if (size > UINT32_MAX)
+		die("%s: too large", file);
+
+	uint8_t* out = calloc(size, 1);
+	if (out == NULL)
+		die("out of memory%s", "");
+
+	memcpy(out, &h, sizeof(h));
+	for (i = 0; i < count; i++)
+		encode(&levels[i], fmt, out + h.levels[i].offset);
+
+	FILE* f = fopen(file, "wb");
+	if (f == NULL || fwrite(out, size, 1, f) != 1 || fclose(f) != 0)
+		die("cannot write %s", file);
+
+	printf("%s: %ux%u %s, %d levels, %lu bytes\n",
+	       file, h.width, h.height, fmt->name, count, (unsigned long)size);
+	free(out);
+}
+
+
+
+static void usage(void) {
+	fprintf(stderr, "usage: gdt_texconv [-f rgba8888 | rgb888 | rgb565 | rgba4444 | l8] input.tga output.gdtt\n");
+	exit(2);
+}
+
+int main(int argc, char** argv) {
+	const format* fmt = NULL;
+	int i = 1, j;
+
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		switch (argv[i][1]) {
+			case 'f':
+				if (++i >= argc)
+					usage();
+				for (j = 0; j < (int)(sizeof(formats) / sizeof(formats[0])); j++)
+					if (strcmp(argv[i], formats[j].name) == 0)
+						fmt = &formats[j];
+				if (fmt == NULL)
+					usage();
+				break;
+			default: usage();
+		}
+	}
+
+	if (argc - i != 2)
+		usage();
+
+	int width, height;
+	uint8_t* rgba = read_tga(argv[i], &width, &height);
+	if ((width & (width - 1)) != 0 || (height & (height - 1)) != 0)
+		die("%s: width and height must be powers of two, GLES2 can not mipmap others", argv[i]);
+
+	bool translucent = false;
+	for (j = 0; j < width * height; j++)
+		if (rgba[4 * j + 3] != 255)
+			translucent = true;
+	if (fmt == NULL)
+		fmt = &formats[translucent ? 0 : 1];
+
+	level levels[GDT_TEXTURE_MAX_LEVELS];
+	int count = 1;
+	while ((width > height ? width : height) >> count)
+		count++;
+	if (count > GDT_TEXTURE_MAX_LEVELS)
+		die("%s: too large", argv[i]);
+
+	levels[0].width = width;
+	levels[0].height = height;
+	levels[0].rgba = xrealloc(NULL, (size_t)width * height * 4 * sizeof(float));
+	for (j = 0; j < width * height * 4; j++)
+		levels[0].rgba[j] = (j & 3) == 3 ? rgba[j] / 255.0f : to_linear(rgba[j] / 255.0f);
+	free(rgba);
+
+	for (j = 1; j < count; j++)
+		levels[j] = downsample(&levels[j - 1]);
+
+	write_texture(argv[i + 1], levels, count, fmt);
+	for (j = 0; j < count; j++)
+		free(levels[j].rgba);
+	return 0;
+}
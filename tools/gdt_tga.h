@@ -0,0 +1,129 @@
+/*
+ * gdt_tga.h
+ *
+ * Copyright (c) 2011 Rickard Edström
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef gdt_tga_h
+#define gdt_tga_h
+
+/* TGA reading shared by the host tools. The runtime has a decoder of its
+ * own in gdt_gles2.c, for mapped resources and in GL pixel formats.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* tga_read -- Read an uncompressed or RLE true color TGA (24/32 bpp) into
+ * RGBA, top row first. On failure returns NULL and sets *error to a
+ * message with a %s for the file name.
+ */
+static uint8_t* tga_read(const char* file, int* width, int* height, const char** error) {
+	FILE* f = fopen(file, "rb");
+	if (f == NULL) {
+		*error = "cannot open %s";
+		return NULL;
+	}
+
+	uint8_t* rgba = NULL;
+	uint8_t h[18];
+	if (fread(h, sizeof(h), 1, f) != 1) {
+		*error = "%s: not a TGA file";
+		goto fail;
+	}
+
+	int type = h[2];
+	int w = h[12] | h[13] << 8;
+	int hgt = h[14] | h[15] << 8;
+	int bpp = h[16];
+	bool topDown = (h[17] & 0x20) != 0;
+
+	if ((type != 2 && type != 10) || (bpp != 24 && bpp != 32) || h[1] != 0) {
+		*error = "%s: only uncompressed or RLE true color TGA (24/32 bpp) is supported";
+		goto fail;
+	}
+	if (w == 0 || hgt == 0) {
+		*error = "%s: empty image";
+		goto fail;
+	}
+
+	fseek(f, h[0], SEEK_CUR); // image ID
+
+	int bytes = bpp / 8;
+	int n = w * hgt;
+	rgba = (uint8_t*)malloc((size_t)n * 4);
+	if (rgba == NULL) {
+		*error = "%s: out of memory";
+		goto fail;
+	}
+	uint8_t px[4] = { 0, 0, 0, 255 };
+	int i = 0;
+
+	while (i < n) {
+		int run = 1;
+		bool repeat = false;
+
+		if (type == 10) {
+			int c = fgetc(f);
+			if (c == EOF) {
+				*error = "%s: truncated";
+				goto fail;
+			}
+			run = (c & 0x7f) + 1;
+			repeat = (c & 0x80) != 0;
+		}
+
+		int j;
+		for (j = 0; j < run && i < n; j++, i++) {
+			if (j == 0 || !repeat) {
+				if (fread(px, bytes, 1, f) != 1) {
+					*error = "%s: truncated";
+					goto fail;
+				}
+				if (bytes == 3)
+					px[3] = 255;
+			}
+
+			// pixels are stored as BGRA, rows bottom-up unless topDown
+			int row = i / w;
+			int col = i % w;
+			uint8_t* out = rgba + 4 * ((topDown ? row : hgt - 1 - row) * w + col);
+			out[0] = px[2];
+			out[1] = px[1];
+			out[2] = px[0];
+			out[3] = px[3];
+		}
+	}
+
+	fclose(f);
+	*width = w;
+	*height = hgt;
+	return rgba;
+
+fail:
+	free(rgba);
+	fclose(f);
+	return NULL;
+}
+
+#endif // gdt_tga_h